@@ -0,0 +1,360 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+/* for struct ucred */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "util.h"
+#include "trace.h"
+#include "scgi_proxy.h"
+#include "cache_daemon.h"
+
+#define ACCEPT_BACKOFF_MS 100
+
+/* Only calls that merely read session state may be answered from the
+ * cache, everything else is passed straight through. */
+static const char *cacheable_methods[] = {
+    "d.multicall", "d.multicall2", "f.multicall", "p.multicall",
+    "t.multicall", "system.listMethods", "system.client_version", NULL
+};
+
+typedef struct {
+    char *request;
+    size_t request_length;
+    char *response;
+    size_t response_length;
+    uint64_t fetched;
+} cache_entry;
+
+typedef struct {
+    cache_entry *entries;
+    size_t size;
+    size_t allocated;
+} response_cache;
+
+static volatile sig_atomic_t stopping;
+
+static void stop_serving(int signum) {
+    (void) signum;
+    stopping = 1;
+}
+
+/* The directory under /tmp has a name anybody can guess and create first,
+ * so neither it nor $XDG_RUNTIME_DIR/rtorrent-cli is trusted unless it is
+ * a real directory that belongs to us and nobody else can enter. */
+static bool dir_is_private(const char *dir) {
+    struct stat st;
+
+    if (lstat(dir, &st) < 0)
+        return false;
+
+    return S_ISDIR(st.st_mode) && st.st_uid == getuid() && (st.st_mode & 0777) == 0700;
+}
+
+/* The daemon socket and the --listen FIFO live in $XDG_RUNTIME_DIR/rtorrent-cli,
+ * or in a per user directory under /tmp. Fails if the directory is not
+ * private, create makes it first if it is missing. */
+int cache_daemon_runtime_dir(char *buf, size_t len, bool create) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    int n;
+
+    assert(buf);
+
+    if (runtime && *runtime)
+        n = snprintf(buf, len, "%s/rtorrent-cli", runtime);
+    else
+        n = snprintf(buf, len, "/tmp/rtorrent-cli-%ld", (long) getuid());
+
+    if (n < 0 || (size_t) n >= len)
+        return -1;
+
+    /* mkdir honours the umask, which may leave the mode short of 0700 */
+    if (create && mkdir(buf, 0700) == 0)
+        chmod(buf, 0700);
+
+    return dir_is_private(buf) ? 0 : -1;
+}
+
+/* The socket is named after the upstream endpoint so that every client of
+ * the same rtorrent finds the same daemon. */
+int cache_daemon_socket_path(char *buf, size_t len, const char *server, const char *port) {
+    char dir[108];
+    int n;
+
+    assert(buf);
+    assert(server);
+    assert(port);
+
+    if (strchr(server, '/') || strchr(port, '/'))
+        return -1;
+
+    if (cache_daemon_runtime_dir(dir, sizeof(dir), false) < 0)
+        return -1;
+
+    n = snprintf(buf, len, "%s/%s:%s.sock", dir, server, port);
+    if (n < 0 || (size_t) n >= len)
+        return -1;
+
+    return 0;
+}
+
+/* Only a daemon run by ourselves gets to see and answer our calls. */
+bool cache_daemon_trusted(int sockfd) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return false;
+
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+
+    return getpeereid(sockfd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+int cache_daemon_connect(int *sockfd, const char *server, const char *port) {
+    char path[108];
+
+    if (cache_daemon_socket_path(path, sizeof(path), server, port) < 0)
+        return -1;
+
+    if (scgi_create_transportu(sockfd, path) != 0)
+        return -1;
+
+    if (!cache_daemon_trusted(*sockfd)) {
+        close(*sockfd);
+        *sockfd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* frame has been validated by scgi_read_request(), so the body starts
+ * right after the netstring header. */
+static bool is_cacheable(const char *frame, size_t frame_length) {
+    const char *body, *name, *end;
+    char *colon;
+    size_t len;
+
+    len = strtoul(frame, &colon, 10);
+    body = colon + 1 + len + 1;
+
+    if (!(name = strstr(body, "<methodName>")))
+        return false;
+    name += sizeof("<methodName>")-1;
+
+    if (!(end = strstr(name, "</methodName>")) || end > frame + frame_length)
+        return false;
+    len = end - name;
+
+    for (const char **m = cacheable_methods; *m; ++m)
+        if (strlen(*m) == len && strncmp(*m, name, len) == 0)
+            return true;
+
+    return false;
+}
+
+static void cache_expire(response_cache *cache, uint64_t now, uint64_t fresh) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < cache->size; ++i) {
+        cache_entry *entry = &cache->entries[i];
+
+        if (now - entry->fetched < fresh) {
+            cache->entries[kept++] = *entry;
+            continue;
+        }
+
+        xfree(entry->request);
+        xfree(entry->response);
+    }
+
+    cache->size = kept;
+}
+
+static cache_entry *cache_find(response_cache *cache, const char *frame, size_t frame_length) {
+    for (size_t i = 0; i < cache->size; ++i)
+        if (cache->entries[i].request_length == frame_length &&
+            memcmp(cache->entries[i].request, frame, frame_length) == 0)
+            return &cache->entries[i];
+
+    return NULL;
+}
+
+static void cache_add(response_cache *cache, char *frame, size_t frame_length,
+                      char *response, size_t response_length) {
+    cache_entry *entry;
+
+    if (cache->size == cache->allocated) {
+        cache->allocated = cache->allocated ? cache->allocated * 2 : 8;
+        cache->entries = xrealloc(cache->entries, sizeof(cache_entry) * cache->allocated);
+    }
+
+    entry = &cache->entries[cache->size++];
+    entry->request = frame;
+    entry->request_length = frame_length;
+    entry->response = response;
+    entry->response_length = response_length;
+    entry->fetched = trace_now();
+}
+
+static int fetch_upstream(const char *server, const char *port, const char *frame,
+                          size_t frame_length, char **response) {
+    int sockfd = -1, ret;
+
+    if (scgi_create_transport(&sockfd, server, port) != 0)
+        return -1;
+
+    ret = scgi_forward(sockfd, frame, frame_length, response);
+    close(sockfd);
+
+    return ret;
+}
+
+static void handle_client(int sockfd, response_cache *cache, const char *server, const char *port) {
+    char *frame, *response = NULL;
+    size_t frame_length;
+    cache_entry *entry;
+    int n;
+
+    if (scgi_read_request(sockfd, &frame, &frame_length) < 0)
+        return;
+
+    if ((entry = cache_find(cache, frame, frame_length))) {
+        scgi_send(sockfd, entry->response, entry->response_length);
+        xfree(frame);
+        return;
+    }
+
+    if ((n = fetch_upstream(server, port, frame, frame_length, &response)) <= 0) {
+        xfree(response);
+        xfree(frame);
+        return;
+    }
+
+    scgi_send(sockfd, response, n);
+
+    if (is_cacheable(frame, frame_length))
+        cache_add(cache, frame, frame_length, response, n);
+    else {
+        xfree(response);
+        xfree(frame);
+    }
+}
+
+/* Requests are handled one at a time. Callers that connect while an
+ * upstream call is in flight wait in the listen backlog and are then
+ * answered from the fresh cache entry, so a burst of identical queries
+ * costs rtorrent a single call per freshness window. A client that
+ * stops reading or writing is dropped after the socket timeouts instead
+ * of holding up everyone else. */
+int cache_daemon_serve(const char *server, const char *port, unsigned int fresh_ms) {
+    struct sigaction sa;
+    struct timeval timeout = { 2, 0 };
+    response_cache cache = { NULL, 0, 0 };
+    uint64_t fresh = (uint64_t) fresh_ms * 1000000;
+    char path[108], dir[108];
+    int listenfd, ret = 0;
+
+    assert(server);
+    assert(port);
+
+    if (cache_daemon_runtime_dir(dir, sizeof(dir), true) < 0) {
+        fprintf(stderr, "ERROR: %s is missing or not a private directory of ours\n", dir);
+        return -1;
+    }
+
+    if (cache_daemon_socket_path(path, sizeof(path), server, port) < 0) {
+        fprintf(stderr, "ERROR: Socket path for %s:%s is too long\n", server, port);
+        return -1;
+    }
+
+    /* a socket that nobody answers on is left over from a dead daemon */
+    if (scgi_create_transportu(&listenfd, path) == 0) {
+        fprintf(stderr, "ERROR: A daemon is already serving %s\n", path);
+        close(listenfd);
+        return -1;
+    }
+    unlink(path);
+
+    if (scgi_create_listeneru(&listenfd, path) != 0) {
+        fprintf(stderr, "ERROR: Could not listen on %s\n", path);
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_serving;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!stopping) {
+        int sockfd = accept(listenfd, NULL, NULL);
+
+        if (sockfd < 0) {
+            struct timespec backoff = { 0, ACCEPT_BACKOFF_MS * 1000000L };
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                nanosleep(&backoff, NULL);
+                continue;
+            }
+
+            fprintf(stderr, "ERROR: Could not accept connections: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        cache_expire(&cache, trace_now(), fresh);
+        handle_client(sockfd, &cache, server, port);
+        close(sockfd);
+    }
+
+    close(listenfd);
+    unlink(path);
+
+    cache_expire(&cache, UINT64_MAX, 0);
+    xfree(cache.entries);
+
+    return ret;
+}
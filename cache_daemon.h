@@ -0,0 +1,34 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef cachedaemonh
+#define cachedaemonh
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CACHE_DAEMON_FRESH_MS 1000
+
+int cache_daemon_runtime_dir(char *buf, size_t len, bool create);
+int cache_daemon_socket_path(char *buf, size_t len, const char *server, const char *port);
+bool cache_daemon_trusted(int sockfd);
+int cache_daemon_connect(int *sockfd, const char *server, const char *port);
+int cache_daemon_serve(const char *server, const char *port, unsigned int fresh_ms);
+
+#endif
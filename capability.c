@@ -0,0 +1,209 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "capability.h"
+
+#define CACHE_LINE_MAX 4096
+
+static const struct {
+    const char *method;
+    unsigned int flag;
+} known_methods[] = {
+    { "d.multicall2", CAP_D_MULTICALL2 },
+    { "system.multicall", CAP_SYSTEM_MULTICALL },
+    { "f.multicall", CAP_F_MULTICALL },
+    { "load.raw_start", CAP_LOAD_RAW_START },
+    { NULL, 0 }
+};
+
+/* The cache lives in $XDG_CACHE_HOME/rtorrent-cli/capabilities, one
+ * "endpoint<TAB>probed<TAB>flags<TAB>version" line per server. */
+static char *cache_dir() {
+    return user_dir("XDG_CACHE_HOME", ".cache");
+}
+
+static char *cache_file(const char *dir, const char *name) {
+    char *path = xmalloc(strlen(dir)+strlen(name)+2);
+
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static bool parse_line(char *line, const char *endpoint, capability_set *caps) {
+    char *tab, *end;
+    size_t len = strlen(endpoint);
+
+    if (strncmp(line, endpoint, len) != 0 || line[len] != '\t')
+        return false;
+
+    tab = line+len+1;
+    caps->probed = (time_t) strtoll(tab, &end, 10);
+    if (*end != '\t')
+        return false;
+
+    caps->flags = (unsigned int) strtoul(end+1, &end, 10);
+    if (*end != '\t')
+        return false;
+
+    snprintf(caps->version, sizeof(caps->version), "%s", end+1);
+    caps->version[strcspn(caps->version, "\n")] = '\0';
+
+    return true;
+}
+
+bool capability_load(const char *endpoint, capability_set *caps) {
+    char line[CACHE_LINE_MAX];
+    char *dir, *path;
+    bool found = false;
+    time_t now = time(NULL);
+    FILE *f;
+
+    assert(endpoint);
+    assert(caps);
+
+    if (!(dir = cache_dir()))
+        return false;
+
+    path = cache_file(dir, "capabilities");
+    if (!(f = fopen(path, "r")))
+        goto finish;
+
+    while (!found && fgets(line, sizeof(line), f))
+        found = parse_line(line, endpoint, caps);
+
+    fclose(f);
+
+    if (found && (caps->probed > now || now - caps->probed >= CAPABILITY_TTL))
+        found = false;
+
+finish:
+    xfree(path);
+    xfree(dir);
+    return found;
+}
+
+/* Rewrites the whole cache through a temporary file of its own, so that
+ * concurrent readers never see a half written line and concurrent writers
+ * never share one. Failing to write the cache is not fatal, the next run
+ * simply probes again. */
+void capability_store(const char *endpoint, const capability_set *caps) {
+    char line[CACHE_LINE_MAX];
+    char *dir, *path, *tmp_path;
+    size_t len;
+    FILE *in, *out;
+    int fd;
+
+    assert(endpoint);
+    assert(caps);
+
+    len = strlen(endpoint);
+
+    if (!(dir = cache_dir()))
+        return;
+
+    path = cache_file(dir, "capabilities");
+    tmp_path = cache_file(dir, "capabilities.XXXXXX");
+
+    *strrchr(dir, '/') = '\0';
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+        goto finish;
+    dir[strlen(dir)] = '/';
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+        goto finish;
+
+    if ((fd = mkstemp(tmp_path)) < 0)
+        goto finish;
+
+    if (!(out = fdopen(fd, "w"))) {
+        close(fd);
+        remove(tmp_path);
+        goto finish;
+    }
+
+    if ((in = fopen(path, "r"))) {
+        while (fgets(line, sizeof(line), in))
+            if (strncmp(line, endpoint, len) != 0 || line[len] != '\t')
+                fputs(line, out);
+        fclose(in);
+    }
+
+    fprintf(out, "%s\t%lld\t%u\t%s\n", endpoint, (long long) caps->probed,
+            caps->flags, caps->version);
+
+    if (fclose(out) == 0)
+        rename(tmp_path, path);
+    else
+        remove(tmp_path);
+
+finish:
+    xfree(tmp_path);
+    xfree(path);
+    xfree(dir);
+}
+
+void capability_from_methods(xmlrpc_env *env, xmlrpc_value *methods, capability_set *caps) {
+    int size;
+
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(caps);
+
+    caps->flags = 0;
+
+    if (xmlrpc_value_type(methods) != XMLRPC_TYPE_ARRAY) {
+        xmlrpc_env_set_fault_formatted(env, -32300, "system.listMethods did not return an array");
+        return;
+    }
+
+    size = xmlrpc_array_size(env, methods);
+    if (env->fault_occurred)
+        return;
+
+    for (int i = 0; i < size; ++i) {
+        xmlrpc_value *item = NULL;
+        const char *name;
+
+        xmlrpc_array_read_item(env, methods, i, &item);
+        if (env->fault_occurred)
+            return;
+
+        if (xmlrpc_value_type(item) == XMLRPC_TYPE_STRING) {
+            xmlrpc_read_string(env, item, &name);
+            if (env->fault_occurred) {
+                xmlrpc_DECREF(item);
+                return;
+            }
+
+            for (int j = 0; known_methods[j].method; ++j)
+                if (strcmp(name, known_methods[j].method) == 0)
+                    caps->flags |= known_methods[j].flag;
+
+            xfree((char*) name);
+        }
+        xmlrpc_DECREF(item);
+    }
+}
@@ -0,0 +1,48 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef capabilityh
+#define capabilityh
+
+#include <stdbool.h>
+#include <time.h>
+#include <xmlrpc-c/base.h>
+
+/* How long a probed capability set stays valid, in seconds. */
+#define CAPABILITY_TTL (60 * 60 * 24)
+
+enum {
+    CAP_D_MULTICALL2        = 1 << 0,
+    CAP_SYSTEM_MULTICALL    = 1 << 1,
+    CAP_F_MULTICALL         = 1 << 2,
+    CAP_LOAD_RAW_START      = 1 << 3
+};
+
+typedef struct {
+    unsigned int flags;
+    time_t probed;
+    char version[32];
+} capability_set;
+
+bool capability_load(const char *endpoint, capability_set *caps);
+void capability_store(const char *endpoint, const capability_set *caps);
+
+void capability_from_methods(xmlrpc_env *env, xmlrpc_value *methods, capability_set *caps);
+
+#endif
@@ -0,0 +1,521 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <xmlrpc-c/base.h>
+
+#include "util.h"
+#include "trace.h"
+#include "xmlrpc_client.h"
+#include "cache_daemon.h"
+#include "events.h"
+
+#define EVENT_LINE_MAX 4096
+
+static const struct {
+    const char *event;
+    const char *name;
+} watched_events[] = {
+    { "event.download.inserted_new", "inserted" },
+    { "event.download.finished", "finished" },
+    { "event.download.erased", "erased" },
+    { "event.download.paused", "paused" },
+    { "event.download.resumed", "resumed" },
+    { "event.download.hash_done", "hash_done" },
+    { NULL, NULL }
+};
+
+/* Runs in rtorrent with the FIFO as $0. Opening it read-write never
+ * blocks, so a handler left behind by a listener that died does not hang
+ * around waiting for a reader. esc is a backslash as it has to be written
+ * to reach sh, installed handlers double it to survive rtorrent's own
+ * unquoting. */
+#define HANDLER_SCRIPT(esc) \
+    "set -f; IFS=; [ -p $0 ] && exec 3<>$0 && printf '%s" esc "t%s" esc "t%s" esc "n' $1 $2 $3 >&3"
+#define HANDLER_ESCAPED HANDLER_SCRIPT("\\\\")
+
+/* How long rtorrent gets to answer the probe at startup. */
+#define PROBE_TIMEOUT_MS 5000
+
+typedef struct {
+    const char *server;
+    const char *port;
+    char key[32];
+    char *fifo;
+} listener;
+
+static volatile sig_atomic_t stopping;
+
+static void stop_listening(int signum) {
+    (void) signum;
+    stopping = 1;
+}
+
+/* The FIFO sits next to the cache daemon sockets, in the same private
+ * directory, and carries the pid of the listener so that several of them
+ * can run side by side. */
+static int fifo_path(char *buf, size_t len, long pid) {
+    char dir[108];
+    int n;
+
+    assert(buf);
+
+    if (cache_daemon_runtime_dir(dir, sizeof(dir), true) < 0)
+        return -1;
+
+    n = snprintf(buf, len, "%s/events-%ld", dir, pid);
+    if (n < 0 || (size_t) n >= len)
+        return -1;
+
+    return 0;
+}
+
+static xmlrpc_value *string_params(xmlrpc_env *env, const char **strings) {
+    xmlrpc_value *params, *tmp;
+
+    params = xmlrpc_array_new(env);
+    for (; *strings && !env->fault_occurred; ++strings) {
+        xmlrpc_array_append_item(env, params, tmp = xmlrpc_string_new(env, *strings));
+        xmlrpc_DECREF(tmp);
+    }
+
+    if (env->fault_occurred) {
+        xmlrpc_DECREF(params);
+        return NULL;
+    }
+
+    return params;
+}
+
+static void call_strings(xmlrpc_env *env, const listener *l, const char *method,
+                         const char **strings, xmlrpc_value **result) {
+    xmlrpc_value *params;
+
+    *result = NULL;
+
+    if (!(params = string_params(env, strings)))
+        return;
+
+    *result = xmlrpc_call_scgi_server_params(env, l->server, l->port, method, params);
+}
+
+/* Builds the command rtorrent runs for an event: the handler script gets
+ * the FIFO, the event name, and the hash and name of the download. */
+static char *handler_command(const listener *l, const char *name) {
+    size_t len = strlen(l->fifo);
+    char *command, *p;
+
+    command = xmalloc(sizeof("execute.nothrow.bg=sh,-c,\"" HANDLER_ESCAPED "\",\"\",,$d.hash=,$d.name=")
+                      + 2 * len + strlen(name));
+
+    p = command + sprintf(command, "execute.nothrow.bg=sh,-c,\"%s\",\"", HANDLER_ESCAPED);
+    for (size_t i = 0; i < len; ++i) {
+        if (l->fifo[i] == '"' || l->fifo[i] == '\\')
+            *p++ = '\\';
+        *p++ = l->fifo[i];
+    }
+    sprintf(p, "\",%s,$d.hash=,$d.name=", name);
+
+    return command;
+}
+
+/* An empty command removes the handler again. */
+static void set_handlers(xmlrpc_env *env, const listener *l, bool install) {
+    for (size_t i = 0; watched_events[i].event; ++i) {
+        xmlrpc_value *result;
+        char *command = install ? handler_command(l, watched_events[i].name) : NULL;
+        const char *strings[] = { "", watched_events[i].event, l->key, command, NULL };
+
+        call_strings(env, l, "method.set_key", strings, &result);
+        xfree(command);
+
+        if (result)
+            xmlrpc_DECREF(result);
+        if (env->fault_occurred)
+            return;
+    }
+}
+
+/* Removal is best effort, rtorrent may be gone already. */
+static void remove_handler(const listener *l, const char *event, const char *key) {
+    xmlrpc_env e;
+    xmlrpc_value *result;
+    const char *strings[] = { "", event, key, NULL };
+
+    xmlrpc_env_init(&e);
+    call_strings(&e, l, "method.set_key", strings, &result);
+    if (result)
+        xmlrpc_DECREF(result);
+    xmlrpc_env_clean(&e);
+}
+
+static void remove_handlers(const listener *l) {
+    for (size_t i = 0; watched_events[i].event; ++i)
+        remove_handler(l, watched_events[i].event, l->key);
+}
+
+/* A key of another listener is stale once that listener is gone. Since
+ * rtorrent has to run on this host, so does every listener, and its pid
+ * tells whether it is still around wherever its FIFO lives. */
+static bool stale_key(const listener *l, const char *key, long *pid) {
+    char *end;
+
+    if (strncmp(key, "rtcli_", 6) != 0 || strcmp(key, l->key) == 0)
+        return false;
+
+    *pid = strtol(key + 6, &end, 10);
+    if (end == key + 6 || *end != '\0' || *pid <= 0)
+        return false;
+
+    return kill((pid_t) *pid, 0) < 0 && errno == ESRCH;
+}
+
+/* A listener killed with SIGKILL leaves its FIFO behind as well. Only
+ * our own runtime directory is looked at, the FIFOs of other users are
+ * theirs to clean up. */
+static void remove_stale_fifo(long pid) {
+    char path[108];
+    struct stat st;
+
+    if (fifo_path(path, sizeof(path), pid) < 0)
+        return;
+
+    if (lstat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+        unlink(path);
+}
+
+/* Drops the handlers that listeners which did not exit cleanly left
+ * behind, each one would otherwise fork a shell on every event. */
+static void remove_stale_handlers(const listener *l) {
+    size_t removed = 0;
+
+    for (size_t i = 0; watched_events[i].event; ++i) {
+        const char *strings[] = { "", watched_events[i].event, NULL };
+        xmlrpc_value *result;
+        xmlrpc_env e;
+        int size;
+
+        xmlrpc_env_init(&e);
+
+        call_strings(&e, l, "method.get", strings, &result);
+        if (e.fault_occurred || xmlrpc_value_type(result) != XMLRPC_TYPE_STRUCT)
+            goto next;
+
+        size = xmlrpc_struct_size(&e, result);
+        for (int j = 0; j < size && !e.fault_occurred; ++j) {
+            xmlrpc_value *name, *command;
+            const char *key;
+
+            xmlrpc_struct_read_member(&e, result, j, &name, &command);
+            if (e.fault_occurred)
+                break;
+
+            xmlrpc_read_string(&e, name, &key);
+            if (!e.fault_occurred) {
+                long pid;
+
+                if (stale_key(l, key, &pid)) {
+                    remove_handler(l, watched_events[i].event, key);
+                    remove_stale_fifo(pid);
+                    removed++;
+                }
+                xfree((char*) key);
+            }
+
+            xmlrpc_DECREF(command);
+            xmlrpc_DECREF(name);
+        }
+
+    next:
+        if (result)
+            xmlrpc_DECREF(result);
+        xmlrpc_env_clean(&e);
+    }
+
+    if (removed > 0)
+        fprintf(stderr, "Removed %zu stale event handlers\n", removed);
+}
+
+static int64_t server_pid(xmlrpc_env *env, const listener *l) {
+    const char *strings[] = { NULL };
+    xmlrpc_value *result;
+    xmlrpc_int64 pid = -1;
+    int small;
+
+    call_strings(env, l, "system.pid", strings, &result);
+    if (env->fault_occurred)
+        return -1;
+
+    if (xmlrpc_value_type(result) == XMLRPC_TYPE_I8)
+        xmlrpc_read_i8(env, result, &pid);
+    else if (xmlrpc_value_type(result) == XMLRPC_TYPE_INT) {
+        xmlrpc_read_int(env, result, &small);
+        pid = small;
+    } else
+        xmlrpc_env_set_fault(env, -32300, "system.pid did not return an integer");
+
+    xmlrpc_DECREF(result);
+    return env->fault_occurred ? -1 : (int64_t) pid;
+}
+
+/* Has rtorrent run the handler script once, the way it runs it for
+ * events, and waits for its line. Without this a listener that rtorrent
+ * cannot write to would wait forever: the FIFO is only open to our own
+ * user and only exists on this host. */
+static void probe_handler(xmlrpc_env *env, const listener *l, int fd) {
+    const char *strings[] = { "", "sh", "-c", HANDLER_SCRIPT("\\"), l->fifo, "probe", l->key, "-", NULL };
+    xmlrpc_value *result;
+    struct pollfd pfd;
+    char buf[EVENT_LINE_MAX], expected[48];
+    size_t len = 0;
+    uint64_t deadline;
+
+    call_strings(env, l, "execute.nothrow.bg", strings, &result);
+    if (env->fault_occurred)
+        return;
+    xmlrpc_DECREF(result);
+
+    snprintf(expected, sizeof(expected), "probe\t%s\t-\n", l->key);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    deadline = trace_now() + (uint64_t) PROBE_TIMEOUT_MS * 1000000;
+
+    while (!stopping) {
+        uint64_t now = trace_now();
+        ssize_t n;
+
+        if (now >= deadline)
+            break;
+
+        if (poll(&pfd, 1, (int) ((deadline - now) / 1000000)) < 0 && errno != EINTR)
+            break;
+
+        while (len < sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+            len += n;
+        buf[len] = '\0';
+
+        if (strstr(buf, expected))
+            return;
+        if (len == sizeof(buf) - 1)
+            len = 0;
+    }
+
+    if (!stopping)
+        xmlrpc_env_set_fault(env, -32300, "rtorrent did not write to the FIFO, it has to run "
+                             "on this host as the same user");
+}
+
+/* Lines are "event<TAB>hash<TAB>name", anything else is dropped. */
+static void print_event(char *line) {
+    char *hash, *name;
+
+    if (!(hash = strchr(line, '\t')))
+        return;
+    *hash++ = '\0';
+
+    if (!(name = strchr(hash, '\t')))
+        return;
+    *name++ = '\0';
+
+    printf("%-9s  %s  %s\n", line, hash, name);
+}
+
+static void read_events(int fd, char *buf, size_t *len) {
+    ssize_t n;
+    char *line, *end;
+
+    while ((n = read(fd, buf + *len, EVENT_LINE_MAX - *len)) > 0) {
+        *len += n;
+
+        line = buf;
+        while ((end = memchr(line, '\n', *len - (line - buf)))) {
+            *end = '\0';
+            print_event(line);
+            line = end+1;
+        }
+
+        *len -= line - buf;
+        memmove(buf, line, *len);
+
+        /* a line that does not fit is not ours */
+        if (*len == EVENT_LINE_MAX)
+            *len = 0;
+    }
+
+    fflush(stdout);
+}
+
+/* Watches for the pid changing, reinstalling the handlers after a restart
+ * and retrying on the next beat if that fails. */
+static void heartbeat(const listener *l, int64_t *pid, bool *reachable) {
+    xmlrpc_env e;
+    int64_t now;
+
+    xmlrpc_env_init(&e);
+
+    now = server_pid(&e, l);
+    if (e.fault_occurred) {
+        if (*reachable)
+            fprintf(stderr, "WARNING: Lost rtorrent: %s\n", e.fault_string);
+        *reachable = false;
+        goto finish;
+    }
+
+    if (!*reachable)
+        fprintf(stderr, "Reached rtorrent again\n");
+    *reachable = true;
+
+    if (now == *pid)
+        goto finish;
+
+    set_handlers(&e, l, true);
+    if (e.fault_occurred) {
+        fprintf(stderr, "WARNING: Could not reinstall event handlers: %s\n", e.fault_string);
+        *pid = -1;
+        goto finish;
+    }
+
+    fprintf(stderr, "rtorrent restarted, event handlers reinstalled\n");
+    *pid = now;
+
+finish:
+    xmlrpc_env_clean(&e);
+}
+
+/* Has rtorrent report download events into a FIFO of ours and prints
+ * them as they come, until SIGINT, SIGTERM or SIGHUP. rtorrent writes to
+ * the FIFO itself, so it has to run on the same host and as the same
+ * user; a probe at startup makes sure it can. Returns -1 if listening
+ * failed or rtorrent was out of reach when it stopped. */
+int events_listen(const char *server, const char *port) {
+    struct sigaction sa;
+    struct pollfd pfd;
+    xmlrpc_env e;
+    listener l;
+    char path[108], buf[EVENT_LINE_MAX];
+    size_t len = 0;
+    uint64_t next_beat;
+    int64_t pid;
+    bool reachable = true, installed = false;
+    int fd, ret = -1;
+
+    assert(server);
+    assert(port);
+
+    if (fifo_path(path, sizeof(path), (long) getpid()) < 0) {
+        fprintf(stderr, "ERROR: No private runtime directory for the FIFO\n");
+        return -1;
+    }
+
+    unlink(path);
+    if (mkfifo(path, 0600) < 0) {
+        fprintf(stderr, "ERROR: Could not create %s\n", path);
+        return -1;
+    }
+
+    /* holding a write end ourselves keeps reads from ever seeing EOF */
+    if ((fd = open(path, O_RDWR | O_NONBLOCK)) < 0) {
+        fprintf(stderr, "ERROR: Could not open %s\n", path);
+        unlink(path);
+        return -1;
+    }
+
+    l.server = server;
+    l.port = port;
+    l.fifo = path;
+    snprintf(l.key, sizeof(l.key), "rtcli_%ld", (long) getpid());
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_listening;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    xmlrpc_env_init(&e);
+
+    pid = server_pid(&e, &l);
+    if (!e.fault_occurred) {
+        remove_stale_handlers(&l);
+        probe_handler(&e, &l, fd);
+    }
+    if (!e.fault_occurred && !stopping) {
+        installed = true;
+        set_handlers(&e, &l, true);
+    }
+    if (e.fault_occurred) {
+        fprintf(stderr, "ERROR: %s (%d)\n", e.fault_string, e.fault_code);
+        goto finish;
+    }
+    if (stopping) {
+        ret = 0;
+        goto finish;
+    }
+
+    fprintf(stderr, "Listening for events from %s:%s\n", server, port);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    next_beat = trace_now() + (uint64_t) EVENTS_HEARTBEAT_MS * 1000000;
+
+    while (!stopping) {
+        uint64_t now = trace_now();
+        int timeout = now >= next_beat ? 0 : (int) ((next_beat - now) / 1000000);
+
+        if (poll(&pfd, 1, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "ERROR: Could not wait for events: %s\n", strerror(errno));
+            goto finish;
+        }
+
+        if (pfd.revents & POLLIN)
+            read_events(fd, buf, &len);
+
+        if (trace_now() >= next_beat) {
+            heartbeat(&l, &pid, &reachable);
+            next_beat = trace_now() + (uint64_t) EVENTS_HEARTBEAT_MS * 1000000;
+        }
+    }
+
+    /* stopping while rtorrent is out of reach means events were lost */
+    ret = reachable ? 0 : -1;
+
+finish:
+    if (installed)
+        remove_handlers(&l);
+    xmlrpc_env_clean(&e);
+    close(fd);
+    unlink(path);
+
+    return ret;
+}
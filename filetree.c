@@ -0,0 +1,223 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "util.h"
+#include "utf8.h"
+#include "filetree.h"
+
+typedef struct dir_node {
+    char *name;
+    struct dir_node **children;
+    size_t nchildren;
+    size_t allocated;
+    size_t last;
+    int64_t size;
+    int64_t done;
+    size_t files;
+    size_t direct_files;
+    int prio_min;
+    int prio_max;
+} dir_node;
+
+struct filetree {
+    dir_node *root;
+};
+
+static dir_node *node_new(const char *name, size_t len) {
+    dir_node *node = xmalloc0(sizeof(dir_node));
+
+    node->name = xmalloc(len+1);
+    memcpy(node->name, name, len);
+    node->name[len] = '\0';
+    node->prio_min = node->prio_max = -1;
+    return node;
+}
+
+static void node_free(dir_node *node) {
+    for (size_t i = 0; i < node->nchildren; ++i)
+        node_free(node->children[i]);
+    xfree(node->children);
+    xfree(node->name);
+    xfree(node);
+}
+
+/* Orders the unterminated name against a child's name like strcmp(). */
+static int name_compare(const char *name, size_t len, const char *other) {
+    int cmp = strncmp(name, other, len);
+
+    if (cmp != 0)
+        return cmp;
+    return other[len] == '\0' ? 0 : -1;
+}
+
+/* Children are kept sorted by name and found by binary search. Files
+ * arrive grouped by directory, so the child used last is tried first. */
+static dir_node *node_child(dir_node *node, const char *name, size_t len) {
+    size_t low = 0, high = node->nchildren;
+    dir_node *child;
+
+    if (node->nchildren > 0) {
+        child = node->children[node->last];
+        if (name_compare(name, len, child->name) == 0)
+            return child;
+    }
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = name_compare(name, len, node->children[mid]->name);
+
+        if (cmp == 0) {
+            node->last = mid;
+            return node->children[mid];
+        }
+
+        if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    if (node->nchildren == node->allocated) {
+        node->allocated = node->allocated ? node->allocated * 2 : 4;
+        node->children = xrealloc(node->children, sizeof(dir_node*) * node->allocated);
+    }
+
+    memmove(node->children + low + 1, node->children + low,
+            sizeof(dir_node*) * (node->nchildren - low));
+    node->nchildren++;
+
+    node->last = low;
+    return node->children[low] = node_new(name, len);
+}
+
+static void node_account(dir_node *node, int64_t size, int64_t done, int priority) {
+    node->size += size;
+    node->done += done;
+    node->files++;
+
+    if (node->prio_min < 0 || priority < node->prio_min)
+        node->prio_min = priority;
+    if (priority > node->prio_max)
+        node->prio_max = priority;
+}
+
+filetree *filetree_new(const char *root_name) {
+    filetree *tree = xmalloc(sizeof(filetree));
+
+    assert(root_name);
+
+    tree->root = node_new(root_name, strlen(root_name));
+    return tree;
+}
+
+void filetree_add(filetree *tree, const char *path, size_t len, int64_t size, int64_t done, int priority) {
+    const char *p = path, *end = path + len, *slash;
+    dir_node *node = tree->root;
+
+    assert(path);
+
+    node_account(node, size, done, priority);
+
+    while ((slash = memchr(p, '/', end - p))) {
+        if (slash > p) {
+            node = node_child(node, p, slash - p);
+            node_account(node, size, done, priority);
+        }
+        p = slash + 1;
+    }
+
+    node->direct_files++;
+}
+
+static const char *priority_to_string(const dir_node *node) {
+    if (node->prio_min != node->prio_max)
+        return "Mixed";
+
+    switch (node->prio_max) {
+        case 0:
+            return "Off";
+        case 1:
+            return "Normal";
+        case 2:
+            return "High";
+        default:
+            return "";
+    }
+}
+
+/* Chains of directories that hold nothing but a single subdirectory are
+ * printed on one line, as in "a/b/c/". Names are cut to what is left of
+ * the line like the torrent names of the listing. */
+static void node_print(dir_node *node, int depth, int max_depth, size_t columns) {
+    char size[20], *name = xstrdup(node->name);
+    size_t max_cols = SIZE_MAX;
+    utf8_span span;
+    int done, used;
+
+    while (depth > 0 && node->nchildren == 1 && node->direct_files == 0) {
+        node = node->children[0];
+        name = xrealloc(name, strlen(name) + strlen(node->name) + 2);
+        strcat(strcat(name, "/"), node->name);
+    }
+    if (depth > 0) {
+        name = xrealloc(name, strlen(name) + 2);
+        strcat(name, "/");
+    }
+
+    done = node->size > 0 ? (int) ((double) node->done / node->size * 100) : 100;
+    byte_to_string(size, 20, node->size);
+
+    used = printf("%4d%%  %9s  %7zu  %-6s  %*s", done, size, node->files,
+                  priority_to_string(node), depth * 2, "");
+
+    if (columns > 0)
+        max_cols = columns > (size_t) used + 1 ? columns - used : 1;
+
+    utf8_fit(name, strlen(name), max_cols, &span);
+    utf8_print(stdout, name, &span, 0);
+    putchar('\n');
+    xfree(name);
+
+    if (max_depth > 0 && depth >= max_depth)
+        return;
+
+    for (size_t i = 0; i < node->nchildren; ++i)
+        node_print(node->children[i], depth + 1, max_depth, columns);
+}
+
+void filetree_print(filetree *tree, int max_depth, size_t columns) {
+    assert(tree);
+
+    printf("%-5s  %9s  %7s  %-6s  %s\n", "Done", "Size", "Files", "Prio", "Name");
+    node_print(tree->root, 0, max_depth, columns);
+}
+
+void filetree_free(filetree *tree) {
+    if (!tree)
+        return;
+
+    node_free(tree->root);
+    xfree(tree);
+}
@@ -0,0 +1,37 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef filetreeh
+#define filetreeh
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A trie of the directories of a torrent. Files are only folded into the
+ * totals of the directories above them and never stored, so the tree
+ * stays small however many files a torrent holds. */
+typedef struct filetree filetree;
+
+filetree *filetree_new(const char *root_name);
+void filetree_add(filetree *tree, const char *path, size_t len, int64_t size, int64_t done, int priority);
+/* columns is the width of the terminal, 0 if names need not be cut. */
+void filetree_print(filetree *tree, int max_depth, size_t columns);
+void filetree_free(filetree *tree);
+
+#endif
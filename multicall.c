@@ -0,0 +1,212 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "multicall.h"
+
+typedef struct {
+    const multicall_split *split;
+    size_t lo;
+    size_t hi;
+    multicall_row_fn fn;
+    void *data;
+    xmlrpc_env env;
+} decode_job;
+
+static bool tag_is(const char *tag, const char *close, const char *name) {
+    size_t len = strlen(name);
+
+    if ((size_t) (close - tag) < len || strncmp(tag, name, len) != 0)
+        return false;
+
+    return tag[len] == '>' || tag[len] == '/' || tag[len] == ' ' ||
+           tag[len] == '\t' || tag[len] == '\r' || tag[len] == '\n';
+}
+
+static void push_row(multicall_split *split, size_t *allocated, const char *begin, const char *end) {
+    if (split->size == *allocated) {
+        *allocated = *allocated ? *allocated * 2 : 256;
+        split->rows = xrealloc(split->rows, sizeof(multicall_row) * *allocated);
+    }
+
+    split->rows[split->size].begin = begin;
+    split->rows[split->size].end = end;
+    split->size++;
+}
+
+/* Finds the byte range of every element of the top level array. XML-RPC
+ * escapes '<' inside strings, so every '<' starts a tag and memchr (which
+ * libc vectorizes) can skip straight from one tag to the next. Anything
+ * that is not a plain array response, faults included, is rejected and
+ * left to the regular parser. */
+bool multicall_split_rows(const char *xml, size_t len, multicall_split *split) {
+    const char *p = xml, *end = xml + len, *row_begin = NULL;
+    size_t allocated = 0;
+    int depth = 0;
+    bool want_array = false, seen_top = false;
+
+    assert(xml);
+    assert(split);
+
+    split->rows = NULL;
+    split->size = 0;
+
+    while ((p = memchr(p, '<', end - p))) {
+        const char *tag = p + 1;
+        const char *close = memchr(tag, '>', end - tag);
+
+        if (!close)
+            goto fail;
+
+        if (want_array) {
+            if (!tag_is(tag, close, "array"))
+                goto fail;
+            want_array = false;
+        } else if (tag_is(tag, close, "fault")) {
+            goto fail;
+        } else if (tag_is(tag, close, "value")) {
+            if (close[-1] == '/') {
+                if (depth == 0)
+                    goto fail;
+                if (depth == 1)
+                    push_row(split, &allocated, p, close + 1);
+            } else if (++depth == 1) {
+                if (seen_top)
+                    goto fail;
+                seen_top = want_array = true;
+            } else if (depth == 2)
+                row_begin = p;
+        } else if (*tag == '/' && tag_is(tag + 1, close, "value")) {
+            if (depth == 2)
+                push_row(split, &allocated, row_begin, close + 1);
+            if (--depth < 0)
+                goto fail;
+        }
+
+        p = close + 1;
+    }
+
+    if (depth == 0 && seen_top && !want_array)
+        return true;
+
+fail:
+    multicall_split_free(split);
+    return false;
+}
+
+void multicall_split_free(multicall_split *split) {
+    xfree(split->rows);
+    split->rows = NULL;
+    split->size = 0;
+}
+
+/* Parses rows [lo, hi) one <value> element at a time straight out of the
+ * response, so the reply is never copied. */
+static void decode_range(decode_job *job) {
+    const multicall_row *rows = job->split->rows;
+
+    for (size_t i = job->lo; !job->env.fault_occurred && i < job->hi; ++i) {
+        xmlrpc_value *row = NULL;
+
+        xmlrpc_parse_value_xml(&job->env, rows[i].begin, rows[i].end - rows[i].begin, &row);
+        if (job->env.fault_occurred)
+            break;
+
+        job->fn(&job->env, row, i, job->data);
+        xmlrpc_DECREF(row);
+    }
+}
+
+static void *decode_thread(void *arg) {
+    decode_range(arg);
+    return NULL;
+}
+
+/* Calls fn for every row, with rows spread over up to `threads` threads in
+ * slices of roughly equal byte size. fn may be called concurrently but
+ * always with distinct indexes. The first fault, in row order, is reported
+ * through env. */
+void multicall_decode(xmlrpc_env *env, const multicall_split *split, unsigned int threads,
+                      multicall_row_fn fn, void *data) {
+    decode_job *jobs;
+    pthread_t *tids;
+    bool *started;
+    size_t njobs, total, lo = 0;
+
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(split);
+    assert(fn);
+
+    if (split->size == 0)
+        return;
+
+    njobs = threads < 1 ? 1 : threads;
+    if (njobs > split->size)
+        njobs = split->size;
+
+    jobs = xmalloc0(sizeof(decode_job) * njobs);
+    tids = xmalloc0(sizeof(pthread_t) * njobs);
+    started = xmalloc0(sizeof(bool) * njobs);
+    total = split->rows[split->size-1].end - split->rows[0].begin;
+
+    for (size_t i = 0; i < njobs; ++i) {
+        size_t hi = lo + 1;
+        const char *target = split->rows[0].begin + total / njobs * (i + 1);
+
+        if (i == njobs - 1)
+            hi = split->size;
+        else
+            while (hi < split->size - (njobs - i - 1) && split->rows[hi-1].end < target)
+                hi++;
+
+        jobs[i].split = split;
+        jobs[i].lo = lo;
+        jobs[i].hi = hi;
+        jobs[i].fn = fn;
+        jobs[i].data = data;
+        xmlrpc_env_init(&jobs[i].env);
+        lo = hi;
+    }
+
+    for (size_t i = 1; i < njobs; ++i)
+        started[i] = pthread_create(&tids[i], NULL, decode_thread, &jobs[i]) == 0;
+
+    decode_range(&jobs[0]);
+
+    for (size_t i = 1; i < njobs; ++i) {
+        if (started[i])
+            pthread_join(tids[i], NULL);
+        else
+            decode_range(&jobs[i]);
+    }
+
+    for (size_t i = 0; i < njobs; ++i) {
+        if (jobs[i].env.fault_occurred && !env->fault_occurred)
+            xmlrpc_env_set_fault(env, jobs[i].env.fault_code, jobs[i].env.fault_string);
+        xmlrpc_env_clean(&jobs[i].env);
+    }
+
+    xfree(started);
+    xfree(tids);
+    xfree(jobs);
+}
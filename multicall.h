@@ -0,0 +1,48 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef multicallh
+#define multicallh
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <xmlrpc-c/base.h>
+
+/* Responses smaller than this are not worth splitting across threads. */
+#define MULTICALL_PARALLEL_MIN (1 << 20)
+
+typedef struct {
+    const char *begin;
+    const char *end;
+} multicall_row;
+
+typedef struct {
+    multicall_row *rows;
+    size_t size;
+} multicall_split;
+
+typedef void (*multicall_row_fn)(xmlrpc_env *env, xmlrpc_value *row, size_t index, void *data);
+
+bool multicall_split_rows(const char *xml, size_t len, multicall_split *split);
+void multicall_split_free(multicall_split *split);
+
+void multicall_decode(xmlrpc_env *env, const multicall_split *split, unsigned int threads,
+                      multicall_row_fn fn, void *data);
+
+#endif
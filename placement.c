@@ -0,0 +1,936 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <xmlrpc-c/base.h>
+
+#include "util.h"
+#include "capability.h"
+#include "rtcli.h"
+#include "placement.h"
+
+#define ENDPOINT_LINE_MAX 1024
+
+typedef struct {
+    const char *path;
+    char *data;
+    size_t len;
+    int64_t payload;
+    size_t node;
+    char *error;
+    bool placed;
+} torrent_file;
+
+typedef struct {
+    char *server;
+    char *port;
+    char *endpoint;
+    rtcli_client *client;
+    capability_set caps;
+    bool measure;
+    int probes;
+    char *error;
+    xmlrpc_value *rows;
+    char *default_dir;
+    int64_t torrents;
+    int64_t up_rate;
+    int64_t down_rate;
+    int64_t free_bytes;
+    size_t added;
+    int64_t added_bytes;
+} placement_node;
+
+typedef struct {
+    placement_node *nodes;
+    size_t size;
+} node_list;
+
+typedef struct {
+    torrent_file **files;
+    size_t count;
+} add_batch;
+
+typedef struct {
+    double torrents;
+    double rate;
+    double free;
+} load_scale;
+
+static void node_fail(placement_node *node, const char *message) {
+    if (!node->error)
+        node->error = xstrdup(message);
+}
+
+static void file_fail(torrent_file *file, const char *message) {
+    if (!file->error)
+        file->error = xstrdup(message);
+}
+
+static void add_node(node_list *list, const char *server, const char *port) {
+    placement_node *node;
+
+    for (size_t i = 0; i < list->size; ++i)
+        if (strcmp(list->nodes[i].server, server) == 0 && strcmp(list->nodes[i].port, port) == 0)
+            return;
+
+    list->nodes = xrealloc(list->nodes, sizeof(placement_node) * (list->size+1));
+    node = &list->nodes[list->size++];
+    memset(node, 0, sizeof(placement_node));
+
+    node->server = xstrdup(server);
+    node->port = xstrdup(port);
+    node->endpoint = xmalloc(strlen(server)+strlen(port)+2);
+    sprintf(node->endpoint, "%s:%s", server, port);
+    node->free_bytes = -1;
+}
+
+static char *endpoints_file() {
+    char *dir, *path;
+
+    if (!(dir = user_dir("XDG_CONFIG_HOME", ".config")))
+        return NULL;
+
+    path = xmalloc(strlen(dir)+sizeof("/endpoints"));
+    sprintf(path, "%s/endpoints", dir);
+    xfree(dir);
+
+    return path;
+}
+
+/* One "host[:port]" per line, '#' starts a comment. */
+static void load_endpoints(node_list *list, const char *default_port) {
+    char line[ENDPOINT_LINE_MAX];
+    char *path, *host, *colon;
+    FILE *f;
+
+    if (!(path = endpoints_file()))
+        return;
+
+    if (!(f = fopen(path, "r"))) {
+        xfree(path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        host = line + strspn(line, " \t");
+        host[strcspn(host, " \t\r\n#")] = '\0';
+        if (*host == '\0')
+            continue;
+
+        /* more than one colon is an IPv6 address without a port */
+        colon = strrchr(host, ':');
+        if (colon && colon == strchr(host, ':') && colon[1] != '\0') {
+            *colon = '\0';
+            add_node(list, host, colon+1);
+        } else
+            add_node(list, host, default_port);
+    }
+
+    fclose(f);
+    xfree(path);
+}
+
+static bool bdecode_string(const char **p, const char *end, const char **string, size_t *len) {
+    char *colon;
+    unsigned long long n;
+
+    if (*p >= end || **p < '0' || **p > '9')
+        return false;
+
+    errno = 0;
+    n = strtoull(*p, &colon, 10);
+    if (errno != 0 || colon >= end || *colon != ':' || n > (size_t) (end - colon - 1))
+        return false;
+
+    *string = colon+1;
+    *len = (size_t) n;
+    *p = colon+1+n;
+    return true;
+}
+
+static bool bdecode_int(const char **p, const char *end, int64_t *num) {
+    char *e;
+
+    if (*p >= end || **p != 'i')
+        return false;
+
+    errno = 0;
+    *num = strtoll(*p+1, &e, 10);
+    if (errno != 0 || e == *p+1 || e >= end || *e != 'e')
+        return false;
+
+    *p = e+1;
+    return true;
+}
+
+/* Walks one bencoded value and sums every integer stored under a
+ * "length" key, which is where torrents keep the sizes of their files. */
+static bool bdecode_walk(const char **p, const char *end, int depth, int64_t *payload) {
+    const char *string;
+    size_t len;
+    int64_t num;
+
+    if (*p >= end || depth > 64)
+        return false;
+
+    switch (**p) {
+    case 'i':
+        return bdecode_int(p, end, &num);
+    case 'l':
+    case 'd': {
+        bool dict = **p == 'd';
+
+        ++*p;
+        while (*p < end && **p != 'e') {
+            if (dict) {
+                if (!bdecode_string(p, end, &string, &len))
+                    return false;
+
+                if (len == 6 && memcmp(string, "length", 6) == 0 && *p < end && **p == 'i') {
+                    if (!bdecode_int(p, end, &num) || num < 0)
+                        return false;
+                    *payload += num;
+                    continue;
+                }
+            }
+
+            if (!bdecode_walk(p, end, depth+1, payload))
+                return false;
+        }
+
+        if (*p >= end)
+            return false;
+        ++*p;
+        return true;
+    }
+    default:
+        return bdecode_string(p, end, &string, &len);
+    }
+}
+
+/* Returns the amount of data the torrent describes, or -1 if it is not
+ * a bencoded dictionary. */
+static int64_t payload_size(const char *data, size_t len) {
+    const char *p = data;
+    int64_t payload = 0;
+
+    if (len == 0 || *data != 'd' || !bdecode_walk(&p, data+len, 0, &payload))
+        return -1;
+
+    return payload;
+}
+
+static void run_clients(node_list *list) {
+    struct pollfd *fds = xmalloc(sizeof(struct pollfd) * list->size);
+    size_t *owners = xmalloc(sizeof(size_t) * list->size);
+    nfds_t nfds;
+
+    for (;;) {
+        nfds = 0;
+        for (size_t i = 0; i < list->size; ++i) {
+            rtcli_client *client = list->nodes[i].client;
+
+            if (!client || rtcli_client_pending(client) == 0)
+                continue;
+
+            fds[nfds].fd = rtcli_client_fd(client);
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = i;
+        }
+
+        if (nfds == 0)
+            break;
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (nfds_t i = 0; i < nfds; ++i)
+            if (fds[i].revents)
+                rtcli_client_dispatch(list->nodes[owners[i]].client);
+    }
+
+    xfree(owners);
+    xfree(fds);
+}
+
+static bool read_int64(xmlrpc_env *env, xmlrpc_value *value, int64_t *num) {
+    xmlrpc_int64 tmp = 0;
+    int small = 0;
+
+    switch (xmlrpc_value_type(value)) {
+    case XMLRPC_TYPE_I8:
+        xmlrpc_read_i8(env, value, &tmp);
+        *num = (int64_t) tmp;
+        break;
+    case XMLRPC_TYPE_INT:
+        xmlrpc_read_int(env, value, &small);
+        *num = small;
+        break;
+    default:
+        return false;
+    }
+
+    return !env->fault_occurred;
+}
+
+static void rows_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    placement_node *node = data;
+
+    (void) client;
+
+    if (env->fault_occurred)
+        node_fail(node, env->fault_string);
+    else if (xmlrpc_value_type(result) != XMLRPC_TYPE_ARRAY)
+        node_fail(node, "Unexpected reply to the load query");
+    else {
+        xmlrpc_INCREF(result);
+        node->rows = result;
+    }
+}
+
+/* Servers without directory.default simply compare against the smallest
+ * free space of any download directory. */
+static void directory_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    placement_node *node = data;
+    xmlrpc_env e;
+    const char *dir;
+
+    (void) client;
+
+    if (env->fault_occurred || xmlrpc_value_type(result) != XMLRPC_TYPE_STRING)
+        return;
+
+    xmlrpc_env_init(&e);
+    xmlrpc_read_string(&e, result, &dir);
+    if (!e.fault_occurred)
+        node->default_dir = (char*) dir;
+    xmlrpc_env_clean(&e);
+}
+
+static void query_load(placement_node *node) {
+    xmlrpc_env e;
+    xmlrpc_value *params, *tmp;
+    const char **p;
+    const char *arguments[] = { "main", "d.up.rate=", "d.down.rate=",
+                                "d.free_diskspace=", "d.directory=", NULL };
+    bool multicall2 = node->caps.flags & CAP_D_MULTICALL2;
+
+    if (!node->measure)
+        return;
+
+    xmlrpc_env_init(&e);
+
+    params = xmlrpc_array_new(&e);
+    if (multicall2 && !e.fault_occurred) {
+        xmlrpc_array_append_item(&e, params, tmp = xmlrpc_string_new(&e, ""));
+        xmlrpc_DECREF(tmp);
+    }
+    for (p = arguments; *p && !e.fault_occurred; ++p) {
+        xmlrpc_array_append_item(&e, params, tmp = xmlrpc_string_new(&e, *p));
+        xmlrpc_DECREF(tmp);
+    }
+    if (e.fault_occurred) {
+        node_fail(node, e.fault_string);
+        goto finish;
+    }
+
+    if (rtcli_call(node->client, multicall2 ? "d.multicall2" : "d.multicall", params, rows_done, node) < 0) {
+        node_fail(node, "Could not connect");
+        goto finish;
+    }
+
+    params = xmlrpc_array_new(&e);
+    if (e.fault_occurred || rtcli_call(node->client, "directory.default", params, directory_done, node) < 0)
+        node_fail(node, "Could not connect");
+
+finish:
+    xmlrpc_env_clean(&e);
+}
+
+/* The capability set is only stored and used once both of its probes
+ * are back, the same as the CLI records it. */
+static void probe_finish(placement_node *node) {
+    if (--node->probes > 0 || node->error)
+        return;
+
+    node->caps.probed = time(NULL);
+    capability_store(node->endpoint, &node->caps);
+    query_load(node);
+}
+
+static void probe_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    placement_node *node = data;
+    xmlrpc_env e;
+
+    (void) client;
+
+    xmlrpc_env_init(&e);
+    if (env->fault_occurred)
+        node_fail(node, env->fault_string);
+    else {
+        capability_from_methods(&e, result, &node->caps);
+        if (e.fault_occurred)
+            node_fail(node, e.fault_string);
+    }
+    xmlrpc_env_clean(&e);
+
+    probe_finish(node);
+}
+
+static void version_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    placement_node *node = data;
+    const char *version;
+    xmlrpc_env e;
+
+    (void) client;
+
+    xmlrpc_env_init(&e);
+    if (env->fault_occurred)
+        node_fail(node, env->fault_string);
+    else if (xmlrpc_value_type(result) != XMLRPC_TYPE_STRING)
+        node_fail(node, "system.client_version did not return a string");
+    else {
+        xmlrpc_read_string(&e, result, &version);
+        if (e.fault_occurred)
+            node_fail(node, e.fault_string);
+        else {
+            snprintf(node->caps.version, sizeof(node->caps.version), "%s", version);
+            xfree((char*) version);
+        }
+    }
+    xmlrpc_env_clean(&e);
+
+    probe_finish(node);
+}
+
+static void query_node(placement_node *node, trace *recorder) {
+    xmlrpc_env e;
+    xmlrpc_value *params;
+
+    if (!(node->client = rtcli_client_new(node->server, node->port))) {
+        node_fail(node, "Could not resolve the host");
+        return;
+    }
+    rtcli_client_set_trace(node->client, recorder);
+
+    if (capability_load(node->endpoint, &node->caps)) {
+        query_load(node);
+        return;
+    }
+
+    xmlrpc_env_init(&e);
+
+    params = xmlrpc_array_new(&e);
+    if (e.fault_occurred || rtcli_call(node->client, "system.listMethods", params, probe_done, node) < 0) {
+        node_fail(node, "Could not connect");
+        goto finish;
+    }
+    node->probes++;
+
+    params = xmlrpc_array_new(&e);
+    if (e.fault_occurred || rtcli_call(node->client, "system.client_version", params, version_done, node) < 0)
+        node_fail(node, "Could not connect");
+    else
+        node->probes++;
+
+finish:
+    xmlrpc_env_clean(&e);
+}
+
+/* Sums the rates and picks the free space of the default download
+ * directory's file system, falling back to the tightest one in use. */
+static void summarize_node(placement_node *node) {
+    xmlrpc_env e;
+    int64_t min_all = -1, min_default = -1;
+    size_t dir_len = node->default_dir ? strlen(node->default_dir) : 0;
+    int size;
+
+    if (node->error || !node->rows)
+        return;
+
+    xmlrpc_env_init(&e);
+
+    size = xmlrpc_array_size(&e, node->rows);
+    for (int i = 0; i < size && !e.fault_occurred; ++i) {
+        xmlrpc_value *row, *item;
+        int64_t fields[3] = { 0, 0, 0 };
+        const char *dir = NULL;
+
+        xmlrpc_array_read_item(&e, node->rows, i, &row);
+        if (e.fault_occurred)
+            break;
+
+        for (int j = 0; j < 3 && !e.fault_occurred; ++j) {
+            xmlrpc_array_read_item(&e, row, j, &item);
+            if (e.fault_occurred)
+                break;
+            if (!read_int64(&e, item, &fields[j]) && !e.fault_occurred)
+                xmlrpc_env_set_fault(&e, -32300, "Unexpected reply to the load query");
+            xmlrpc_DECREF(item);
+        }
+
+        if (!e.fault_occurred) {
+            xmlrpc_array_read_item(&e, row, 3, &item);
+            if (!e.fault_occurred) {
+                if (xmlrpc_value_type(item) == XMLRPC_TYPE_STRING)
+                    xmlrpc_read_string(&e, item, &dir);
+                xmlrpc_DECREF(item);
+            }
+        }
+        xmlrpc_DECREF(row);
+
+        if (e.fault_occurred)
+            break;
+
+        node->up_rate += fields[0];
+        node->down_rate += fields[1];
+
+        if (min_all < 0 || fields[2] < min_all)
+            min_all = fields[2];
+        if (dir && dir_len > 0 && strncmp(dir, node->default_dir, dir_len) == 0 &&
+            (min_default < 0 || fields[2] < min_default))
+            min_default = fields[2];
+
+        xfree((char*) dir);
+    }
+
+    if (e.fault_occurred)
+        node_fail(node, e.fault_string);
+
+    node->torrents = size;
+    node->free_bytes = min_default >= 0 ? min_default : min_all;
+
+    xmlrpc_env_clean(&e);
+}
+
+/* Lower is better. Torrent count, transfer rate and used up free space
+ * each add up to about 1, relative to the busiest instance. New torrents
+ * are expected to transfer at the instance's current average. Free space
+ * is only known from existing torrents, an instance without any counts
+ * as full. */
+static double node_load(const placement_node *node, const load_scale *scale) {
+    double rate = (double) (node->up_rate + node->down_rate);
+    double load;
+
+    if (node->torrents > 0)
+        rate += rate / node->torrents * node->added;
+
+    load = (node->torrents + node->added) / scale->torrents + rate / scale->rate;
+    if (node->free_bytes >= 0)
+        load += 1.0 - (double) (node->free_bytes - node->added_bytes) / scale->free;
+    else
+        load += 1.0;
+
+    return load;
+}
+
+static bool has_room(const placement_node *node, int64_t payload) {
+    return node->free_bytes >= 0 && node->free_bytes - node->added_bytes >= payload;
+}
+
+/* Instances of unknown free space are only picked when none of those
+ * known to have room are left. */
+static placement_node *least_loaded(node_list *list, const load_scale *scale, int64_t payload) {
+    placement_node *best = NULL;
+    double best_load = 0;
+
+    for (int pass = 0; pass < 2 && !best; ++pass)
+        for (size_t i = 0; i < list->size; ++i) {
+            placement_node *node = &list->nodes[i];
+            double load;
+
+            if (node->error)
+                continue;
+            if (pass == 0 ? !has_room(node, payload) : node->free_bytes >= 0)
+                continue;
+
+            load = node_load(node, scale);
+            if (!best || load < best_load) {
+                best = node;
+                best_load = load;
+            }
+        }
+
+    return best;
+}
+
+static int compare_payload(const void *a, const void *b) {
+    const torrent_file *fa = *(torrent_file * const *) a;
+    const torrent_file *fb = *(torrent_file * const *) b;
+
+    if (fa->payload != fb->payload)
+        return fa->payload < fb->payload ? 1 : -1;
+
+    return fa < fb ? -1 : fa > fb;
+}
+
+/* Greedy, largest torrent first: each one goes to the instance that is
+ * least loaded with everything placed so far counted in. */
+static void assign_files(node_list *list, torrent_file *files, size_t count) {
+    torrent_file **order = xmalloc(sizeof(torrent_file*) * count);
+    load_scale scale = { 1, 1, 1 };
+    size_t n = 0;
+
+    for (size_t i = 0; i < list->size; ++i) {
+        const placement_node *node = &list->nodes[i];
+
+        if (node->error)
+            continue;
+        if (node->torrents + 1 > scale.torrents)
+            scale.torrents = node->torrents + 1;
+        if (node->up_rate + node->down_rate + 1 > scale.rate)
+            scale.rate = node->up_rate + node->down_rate + 1;
+        if (node->free_bytes + 1 > scale.free)
+            scale.free = node->free_bytes + 1;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (!files[i].error)
+            order[n++] = &files[i];
+
+    qsort(order, n, sizeof(torrent_file*), compare_payload);
+
+    for (size_t i = 0; i < n; ++i) {
+        placement_node *best = least_loaded(list, &scale, order[i]->payload);
+
+        if (!best) {
+            file_fail(order[i], "No instance has room for it");
+            continue;
+        }
+
+        order[i]->node = best - list->nodes;
+        best->added++;
+        best->added_bytes += order[i]->payload;
+    }
+
+    xfree(order);
+}
+
+/* Caches probed before load.raw_start was tracked lack its flag, but any
+ * server that knows d.multicall2 has it as well. */
+static bool has_load_raw_start(const placement_node *node) {
+    return node->caps.flags & (CAP_LOAD_RAW_START | CAP_D_MULTICALL2);
+}
+
+static xmlrpc_value *load_params(xmlrpc_env *e, const placement_node *node, const torrent_file *file) {
+    xmlrpc_value *params, *tmp;
+
+    params = xmlrpc_array_new(e);
+    if (e->fault_occurred)
+        return NULL;
+
+    /* load.raw_start takes a target, which stays empty */
+    if (has_load_raw_start(node)) {
+        xmlrpc_array_append_item(e, params, tmp = xmlrpc_string_new(e, ""));
+        xmlrpc_DECREF(tmp);
+    }
+
+    if (!e->fault_occurred) {
+        xmlrpc_array_append_item(e, params, tmp = xmlrpc_base64_new(e, file->len, (const unsigned char*) file->data));
+        xmlrpc_DECREF(tmp);
+    }
+
+    if (e->fault_occurred) {
+        xmlrpc_DECREF(params);
+        return NULL;
+    }
+
+    return params;
+}
+
+static void single_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    torrent_file *file = data;
+
+    (void) client;
+    (void) result;
+
+    if (env->fault_occurred)
+        file_fail(file, env->fault_string);
+    else
+        file->placed = true;
+}
+
+/* system.multicall wraps each result in a one element array and reports
+ * failed calls as fault structs in their place. */
+static void batch_done(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data) {
+    add_batch *batch = data;
+    xmlrpc_env e;
+
+    (void) client;
+
+    xmlrpc_env_init(&e);
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        xmlrpc_value *item = NULL, *fault = NULL;
+        const char *message = NULL;
+
+        if (env->fault_occurred) {
+            file_fail(batch->files[i], env->fault_string);
+            continue;
+        }
+
+        xmlrpc_array_read_item(&e, result, i, &item);
+        if (e.fault_occurred) {
+            file_fail(batch->files[i], "Missing from the multicall reply");
+            xmlrpc_env_clean(&e);
+            xmlrpc_env_init(&e);
+            continue;
+        }
+
+        if (xmlrpc_value_type(item) == XMLRPC_TYPE_ARRAY)
+            batch->files[i]->placed = true;
+        else {
+            if (xmlrpc_value_type(item) == XMLRPC_TYPE_STRUCT)
+                xmlrpc_struct_find_value(&e, item, "faultString", &fault);
+            if (fault && xmlrpc_value_type(fault) == XMLRPC_TYPE_STRING)
+                xmlrpc_read_string(&e, fault, &message);
+
+            file_fail(batch->files[i], message ? message : "Call failed");
+
+            xfree((char*) message);
+            if (fault)
+                xmlrpc_DECREF(fault);
+            xmlrpc_env_clean(&e);
+            xmlrpc_env_init(&e);
+        }
+
+        xmlrpc_DECREF(item);
+    }
+
+    xmlrpc_env_clean(&e);
+    xfree(batch->files);
+    xfree(batch);
+}
+
+static void send_batch(placement_node *node, add_batch *batch, xmlrpc_value *calls) {
+    xmlrpc_env e;
+    xmlrpc_value *params;
+
+    xmlrpc_env_init(&e);
+
+    params = xmlrpc_array_new(&e);
+    if (!e.fault_occurred)
+        xmlrpc_array_append_item(&e, params, calls);
+    xmlrpc_DECREF(calls);
+
+    if (e.fault_occurred || rtcli_call(node->client, "system.multicall", params, batch_done, batch) < 0) {
+        for (size_t i = 0; i < batch->count; ++i)
+            file_fail(batch->files[i], e.fault_occurred ? e.fault_string : "Could not connect");
+        xfree(batch->files);
+        xfree(batch);
+    }
+
+    xmlrpc_env_clean(&e);
+}
+
+/* Size of the call loading file once serialized: the base64 encoded data,
+ * broken into lines of 76 characters, and the XML around it. */
+static size_t call_size(const torrent_file *file) {
+    size_t encoded = (file->len + 2) / 3 * 4;
+
+    return encoded + encoded / 76 * 2 + PLACEMENT_CALL_OVERHEAD;
+}
+
+/* Everything assigned to one instance goes out in as few system.multicall
+ * round trips as PLACEMENT_BATCH_BYTES allows, or one call per torrent on
+ * servers without it. */
+static void send_files(node_list *list, size_t index, torrent_file *files, size_t count) {
+    placement_node *node = &list->nodes[index];
+    const char *method = has_load_raw_start(node) ? "load.raw_start" : "load_raw_start";
+    bool multicall = node->caps.flags & CAP_SYSTEM_MULTICALL;
+    add_batch *batch = NULL;
+    xmlrpc_value *calls = NULL;
+    size_t batch_bytes = 0;
+    xmlrpc_env e;
+
+    xmlrpc_env_init(&e);
+
+    for (size_t i = 0; i < count; ++i) {
+        torrent_file *file = &files[i];
+        xmlrpc_value *params, *call, *tmp;
+
+        if (file->error || file->node != index)
+            continue;
+
+        if (!(params = load_params(&e, node, file))) {
+            file_fail(file, e.fault_string);
+            xmlrpc_env_clean(&e);
+            xmlrpc_env_init(&e);
+            continue;
+        }
+
+        if (!multicall) {
+            if (rtcli_call(node->client, method, params, single_done, file) < 0)
+                file_fail(file, "Could not connect");
+            continue;
+        }
+
+        if (batch && batch_bytes + call_size(file) > PLACEMENT_BATCH_BYTES) {
+            send_batch(node, batch, calls);
+            batch = NULL;
+        }
+
+        if (!batch) {
+            batch = xmalloc0(sizeof(add_batch));
+            batch->files = xmalloc(sizeof(torrent_file*) * count);
+            calls = xmlrpc_array_new(&e);
+            batch_bytes = 0;
+        }
+
+        call = xmlrpc_struct_new(&e);
+        xmlrpc_struct_set_value(&e, call, "methodName", tmp = xmlrpc_string_new(&e, method));
+        xmlrpc_DECREF(tmp);
+        xmlrpc_struct_set_value(&e, call, "params", params);
+        xmlrpc_DECREF(params);
+        xmlrpc_array_append_item(&e, calls, call);
+        xmlrpc_DECREF(call);
+
+        if (e.fault_occurred) {
+            file_fail(file, e.fault_string);
+            xmlrpc_env_clean(&e);
+            xmlrpc_env_init(&e);
+            continue;
+        }
+
+        batch->files[batch->count++] = file;
+        batch_bytes += call_size(file);
+    }
+
+    if (batch)
+        send_batch(node, batch, calls);
+
+    xmlrpc_env_clean(&e);
+}
+
+static void print_nodes(const node_list *list) {
+    char upstr[20], downstr[20], freestr[20];
+
+    printf("%-24s  %8s  %8s  %8s  %8s  %5s\n",
+           "Endpoint", "Torrents", "Up", "Down", "Free", "Added");
+
+    for (size_t i = 0; i < list->size; ++i) {
+        const placement_node *node = &list->nodes[i];
+
+        if (node->error) {
+            printf("%-24s  %s\n", node->endpoint, node->error);
+            continue;
+        }
+
+        byte_to_string(upstr, 20, node->up_rate);
+        byte_to_string(downstr, 20, node->down_rate);
+        if (node->free_bytes >= 0)
+            byte_to_string(freestr, 20, node->free_bytes);
+        else
+            snprintf(freestr, 20, "-");
+
+        printf("%-24s  %8" PRId64 "  %8s  %8s  %8s  %5zu\n", node->endpoint,
+               node->torrents, upstr, downstr, freestr, node->added);
+    }
+}
+
+int placement_add(const char *server, const char *port, bool auto_place, trace *recorder,
+                  char *const *files, size_t count) {
+    node_list list = { NULL, 0 };
+    torrent_file *torrents;
+    int ret = 0;
+
+    assert(server);
+    assert(port);
+    assert(files);
+
+    add_node(&list, server, port);
+    if (auto_place)
+        load_endpoints(&list, port);
+
+    torrents = xmalloc0(sizeof(torrent_file) * count);
+    for (size_t i = 0; i < count; ++i) {
+        torrent_file *file = &torrents[i];
+
+        file->path = files[i];
+        /* the terminator read_file() adds stops the bencode walker's strtoll */
+        if (!(file->data = read_file(file->path, &file->len)))
+            file_fail(file, strerror(errno));
+        else if ((file->payload = payload_size(file->data, file->len)) < 0)
+            file_fail(file, "Not a torrent file");
+    }
+
+    /* only auto placement needs to know how busy the instances are */
+    for (size_t i = 0; i < list.size; ++i) {
+        list.nodes[i].measure = auto_place;
+        query_node(&list.nodes[i], recorder);
+    }
+    run_clients(&list);
+
+    for (size_t i = 0; i < list.size; ++i)
+        summarize_node(&list.nodes[i]);
+
+    /* without auto placement the one endpoint takes everything */
+    if (auto_place)
+        assign_files(&list, torrents, count);
+    else if (list.nodes[0].error)
+        for (size_t i = 0; i < count; ++i)
+            file_fail(&torrents[i], list.nodes[0].error);
+
+    for (size_t i = 0; i < list.size; ++i)
+        if (!list.nodes[i].error)
+            send_files(&list, i, torrents, count);
+    run_clients(&list);
+
+    if (auto_place)
+        print_nodes(&list);
+
+    for (size_t i = 0; i < count; ++i) {
+        torrent_file *file = &torrents[i];
+
+        if (file->placed)
+            printf("%s -> %s\n", file->path, list.nodes[file->node].endpoint);
+        else {
+            fprintf(stderr, "ERROR: %s: %s\n", file->path, file->error ? file->error : "Not sent");
+            ret = -1;
+        }
+        xfree(file->error);
+        xfree(file->data);
+    }
+    xfree(torrents);
+
+    for (size_t i = 0; i < list.size; ++i) {
+        placement_node *node = &list.nodes[i];
+
+        rtcli_client_free(node->client);
+        if (node->rows)
+            xmlrpc_DECREF(node->rows);
+        xfree(node->default_dir);
+        xfree(node->error);
+        xfree(node->endpoint);
+        xfree(node->port);
+        xfree(node->server);
+    }
+    xfree(list.nodes);
+
+    return ret;
+}
@@ -0,0 +1,43 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef placementh
+#define placementh
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "trace.h"
+
+/* Largest request sent to one instance in a single system.multicall,
+ * rtorrent refuses requests beyond its XML-RPC size limit. Torrents count
+ * with their base64 encoded size plus PLACEMENT_CALL_OVERHEAD for the XML
+ * around each call. A torrent too large for the budget still goes out,
+ * in a call of its own. */
+#define PLACEMENT_BATCH_BYTES (512 * 1024)
+#define PLACEMENT_CALL_OVERHEAD 512
+
+/* Loads the torrent files onto server:port, or with auto_place onto the
+ * least loaded of it and the endpoints listed in
+ * $XDG_CONFIG_HOME/rtorrent-cli/endpoints. Every exchange with them is
+ * written to recorder unless it is NULL. */
+int placement_add(const char *server, const char *port, bool auto_place, trace *recorder,
+                  char *const *files, size_t count);
+
+#endif
@@ -0,0 +1,166 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "util.h"
+#include "trace.h"
+#include "scgi_proxy.h"
+#include "replay.h"
+
+/* How long accept() is given a rest when the process runs out of file
+ * descriptors or memory, rather than retrying it in a busy loop. */
+#define ACCEPT_BACKOFF_MS 100
+
+static bool same_request(const trace_exchange *exchange, const char *frame, size_t len) {
+    return exchange->request_len == len && memcmp(exchange->request, frame, len) == 0;
+}
+
+/* Prefers an exchange with the very same request that has not been
+ * served yet, then any exchange with that request, and otherwise just
+ * moves on to the next one in recording order. */
+static size_t pick_exchange(const trace_log *log, bool *served, size_t *next,
+                            const char *frame, size_t len) {
+    size_t match = log->size;
+
+    for (size_t i = 0; i < log->size; ++i) {
+        if (!same_request(&log->exchanges[i], frame, len))
+            continue;
+
+        if (!served[i]) {
+            match = i;
+            break;
+        }
+        if (match == log->size)
+            match = i;
+    }
+
+    if (match == log->size)
+        match = *next;
+
+    served[match] = true;
+    *next = (match + 1) % log->size;
+    return match;
+}
+
+static void sleep_until(uint64_t deadline) {
+    uint64_t now = trace_now();
+    struct timespec ts;
+
+    if (now >= deadline)
+        return;
+
+    ts.tv_sec = (deadline - now) / 1000000000;
+    ts.tv_nsec = (deadline - now) % 1000000000;
+    nanosleep(&ts, NULL);
+}
+
+static void serve_exchange(int sockfd, const trace_exchange *exchange, bool max_speed) {
+    uint64_t start = trace_now();
+
+    for (size_t i = 0; i < exchange->nchunks; ++i) {
+        const trace_chunk *chunk = &exchange->chunks[i];
+
+        if (!max_speed)
+            sleep_until(start + chunk->at);
+
+        if (scgi_send(sockfd, chunk->data, chunk->len) < 0)
+            return;
+    }
+}
+
+/* Stands in for rtorrent: every connection gets the response bytes of a
+ * recorded exchange, chunked as they were read originally. With
+ * max_speed the chunks are sent back to back, otherwise each one waits
+ * for the offset it arrived at in the recording. */
+int replay_serve(const char *host, const char *port, const char *path, bool max_speed) {
+    trace_log log;
+    bool *served;
+    size_t next = 0;
+    int listenfd, ret = 0;
+
+    assert(port);
+    assert(path);
+
+    if (trace_load(path, &log) < 0) {
+        fprintf(stderr, "ERROR: Could not load trace %s\n", path);
+        return -1;
+    }
+
+    if (log.size == 0) {
+        fprintf(stderr, "ERROR: Trace %s holds no exchanges\n", path);
+        trace_log_free(&log);
+        return -1;
+    }
+
+    if (scgi_create_listener(&listenfd, host, port) != 0) {
+        fprintf(stderr, "ERROR: Could not listen on %s:%s\n", host, port);
+        trace_log_free(&log);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    served = xmalloc0(sizeof(bool) * log.size);
+    fprintf(stderr, "Replaying %zu exchanges on %s:%s\n", log.size, host, port);
+
+    for (;;) {
+        size_t frame_length;
+        char *frame;
+        int sockfd = accept(listenfd, NULL, NULL);
+
+        if (sockfd < 0) {
+            struct timespec backoff = { 0, ACCEPT_BACKOFF_MS * 1000000L };
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                nanosleep(&backoff, NULL);
+                continue;
+            }
+
+            fprintf(stderr, "ERROR: Could not accept connections: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+
+        if (scgi_read_request(sockfd, &frame, &frame_length) == 0) {
+            size_t i = pick_exchange(&log, served, &next, frame, frame_length);
+
+            serve_exchange(sockfd, &log.exchanges[i], max_speed);
+            xfree(frame);
+        }
+
+        close(sockfd);
+    }
+
+    close(listenfd);
+    xfree(served);
+    trace_log_free(&log);
+
+    return ret;
+}
@@ -0,0 +1,767 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "scgi_proxy.h"
+#include "cache_daemon.h"
+#include "capability.h"
+#include "multicall.h"
+#include "trace.h"
+#include "xmlrpc_client.h"
+#include "xmlrpc_stream.h"
+#include "rtcli.h"
+
+#define RTCLI_EVENTS 16
+#define RTCLI_READ_CHUNK 65536
+
+/* rtcli.h mirrors the capability bits without pulling in capability.h */
+typedef char rtcli_capability_bits[(int) CAP_D_MULTICALL2 == (int) RTCLI_D_MULTICALL2 ? 1 : -1];
+
+typedef enum {
+    REQUEST_CONNECTING,
+    REQUEST_WRITING,
+    REQUEST_READING
+} request_state;
+
+typedef struct {
+    uint64_t at;
+    size_t offset;
+    size_t len;
+} request_chunk;
+
+typedef struct rtcli_request {
+    rtcli_client *client;
+    int fd;
+    request_state state;
+    struct addrinfo *next_addr;
+
+    char *frame;
+    size_t frame_length;
+    size_t sent;
+
+    char *reply;
+    size_t reply_length;
+    size_t reply_size;
+
+    /* streamed replies are fed on as they come and only kept for a trace */
+    xmlrpc_stream *stream;
+    bool body_started;
+    size_t fed;
+    rtcli_row_fn row_fn;
+    rtcli_field *fields;
+    size_t fields_allocated;
+
+    uint64_t started;
+    uint64_t deadline;
+    request_chunk *chunks;
+    size_t nchunks;
+
+    rtcli_call_cb call_cb;
+    rtcli_list_cb list_cb;
+    rtcli_done_cb done_cb;
+    void *data;
+
+    struct rtcli_request *prev;
+    struct rtcli_request *next;
+} rtcli_request;
+
+struct rtcli_client {
+    char *server;
+    char *port;
+    int epfd;
+    struct addrinfo *addrs;
+    unsigned int flags;
+    unsigned int threads;
+    unsigned int timeout;
+    trace *recorder;
+    rtcli_request *requests;
+    size_t pending;
+};
+
+/* Resolves server right away, this is the only call that may block. It
+ * returns NULL if the name cannot be resolved. */
+rtcli_client *rtcli_client_new(const char *server, const char *port) {
+    rtcli_client *client;
+    struct addrinfo hints;
+    long cpus;
+
+    assert(server);
+    assert(port);
+
+    client = xmalloc0(sizeof(rtcli_client));
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(server, port, &hints, &client->addrs) != 0) {
+        xfree(client);
+        return NULL;
+    }
+
+    client->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (client->epfd < 0) {
+        freeaddrinfo(client->addrs);
+        xfree(client);
+        return NULL;
+    }
+
+    client->server = xstrdup(server);
+    client->port = xstrdup(port);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    client->threads = cpus > 0 ? (unsigned int) cpus : 1;
+
+    return client;
+}
+
+void rtcli_client_set_capabilities(rtcli_client *client, unsigned int flags) {
+    assert(client);
+    client->flags = flags;
+}
+
+/* Every exchange is written to t once it is over, NULL stops recording.
+ * The trace has to outlive the requests made while it is set. */
+void rtcli_client_set_trace(rtcli_client *client, trace *t) {
+    assert(client);
+    client->recorder = t;
+}
+
+trace *rtcli_trace_open(const char *path) {
+    assert(path);
+    return trace_open(path);
+}
+
+void rtcli_trace_close(trace *t) {
+    trace_close(t);
+}
+
+void rtcli_client_set_threads(rtcli_client *client, unsigned int threads) {
+    assert(client);
+    client->threads = threads > 0 ? threads : 1;
+}
+
+/* Requests submitted from now on fail once they have taken longer than
+ * ms milliseconds, 0 lets them wait forever. */
+void rtcli_client_set_timeout(rtcli_client *client, unsigned int ms) {
+    assert(client);
+    client->timeout = ms;
+}
+
+int rtcli_client_fd(const rtcli_client *client) {
+    assert(client);
+    return client->epfd;
+}
+
+size_t rtcli_client_pending(const rtcli_client *client) {
+    assert(client);
+    return client->pending;
+}
+
+static void request_close(rtcli_request *req) {
+    if (req->fd < 0)
+        return;
+
+    epoll_ctl(req->client->epfd, EPOLL_CTL_DEL, req->fd, NULL);
+    close(req->fd);
+    req->fd = -1;
+}
+
+static int request_watch(rtcli_request *req, uint32_t events, int op) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = req;
+
+    return epoll_ctl(req->client->epfd, op, req->fd, &ev);
+}
+
+static void request_unlink(rtcli_request *req) {
+    rtcli_client *client = req->client;
+
+    if (req->prev)
+        req->prev->next = req->next;
+    else
+        client->requests = req->next;
+
+    if (req->next)
+        req->next->prev = req->prev;
+
+    client->pending--;
+}
+
+static void request_free(rtcli_request *req) {
+    request_close(req);
+    if (req->stream)
+        xmlrpc_stream_free(req->stream);
+    xfree(req->fields);
+    xfree(req->chunks);
+    xfree(req->frame);
+    xfree(req->reply);
+    xfree(req);
+}
+
+/* Strips the SCGI status headers, what is left is the XML-RPC response. */
+static const char *reply_body(rtcli_request *req, size_t *len) {
+    char *body;
+
+    if (!req->reply)
+        return NULL;
+
+    body = strstr(req->reply, "\r\n\r\n");
+    if (!body)
+        return NULL;
+
+    body += 4;
+    *len = req->reply_length - (body - req->reply);
+    return body;
+}
+
+static void complete_call(rtcli_request *req, xmlrpc_env *env, const char *body, size_t len) {
+    xmlrpc_value *result = NULL;
+
+    if (!env->fault_occurred)
+        result = xmlrpc_parse_scgi_response(env, body, len);
+
+    req->call_cb(req->client, env, result, req->data);
+
+    if (result)
+        xmlrpc_DECREF(result);
+}
+
+static void complete_list(rtcli_request *req, xmlrpc_env *env, const char *body, size_t len) {
+    torrent_array *result = NULL;
+    xmlrpc_value *xml_array;
+
+    if (env->fault_occurred)
+        goto finish;
+
+    if (req->client->threads > 1 && len >= MULTICALL_PARALLEL_MIN &&
+        torrent_decode_list_raw(env, body, len, req->client->threads, &result))
+        goto finish;
+
+    xml_array = xmlrpc_parse_scgi_response(env, body, len);
+    if (env->fault_occurred)
+        goto finish;
+
+    torrent_decode_list(env, xml_array, &result);
+    xmlrpc_DECREF(xml_array);
+
+finish:
+    req->list_cb(req->client, env, &result, req->data);
+    torrent_array_free(result);
+}
+
+static void complete_stream(rtcli_request *req, xmlrpc_env *env) {
+    if (!env->fault_occurred) {
+        if (req->body_started)
+            xmlrpc_stream_finish(env, req->stream);
+        else
+            xmlrpc_env_set_fault(env, -32300, "No response from server");
+    }
+
+    req->done_cb(req->client, env, req->data);
+}
+
+static void record_exchange(rtcli_request *req) {
+    trace_chunk *chunks = xmalloc0(sizeof(trace_chunk) * (req->nchunks + 1));
+
+    for (size_t i = 0; i < req->nchunks; ++i) {
+        chunks[i].at = req->chunks[i].at;
+        chunks[i].data = req->reply + req->chunks[i].offset;
+        chunks[i].len = req->chunks[i].len;
+    }
+
+    trace_write_exchange(req->client->recorder, req->started, req->frame, req->frame_length,
+                         chunks, req->nchunks, trace_now());
+    xfree(chunks);
+}
+
+/* Takes the request off the client and hands its outcome to the callback.
+ * A NULL message means the whole reply has been read. */
+static void request_finish(rtcli_request *req, const char *message) {
+    xmlrpc_env env;
+    const char *body = NULL;
+    size_t len = 0;
+
+    request_close(req);
+    request_unlink(req);
+
+    if (req->client->recorder)
+        record_exchange(req);
+
+    xmlrpc_env_init(&env);
+
+    if (message)
+        xmlrpc_env_set_fault(&env, -32300, message);
+    else if (!req->stream && !(body = reply_body(req, &len)))
+        xmlrpc_env_set_fault(&env, -32300, "No response from server");
+
+    if (req->stream)
+        complete_stream(req, &env);
+    else if (req->call_cb)
+        complete_call(req, &env, body, len);
+    else
+        complete_list(req, &env, body, len);
+
+    xmlrpc_env_clean(&env);
+    request_free(req);
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags < 0)
+        return -1;
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Starts a connection attempt on the next resolved address, returns -1
+ * once all of them have been tried. */
+static int request_connect_next(rtcli_request *req) {
+    struct addrinfo *rp;
+
+    while ((rp = req->next_addr)) {
+        req->next_addr = rp->ai_next;
+
+        req->fd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, rp->ai_protocol);
+        if (req->fd < 0)
+            continue;
+
+        if (connect(req->fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+            req->state = REQUEST_WRITING;
+        } else if (errno == EINPROGRESS) {
+            req->state = REQUEST_CONNECTING;
+        } else {
+            close(req->fd);
+            req->fd = -1;
+            continue;
+        }
+
+        if (request_watch(req, EPOLLOUT, EPOLL_CTL_ADD) == 0)
+            return 0;
+
+        close(req->fd);
+        req->fd = -1;
+    }
+
+    return -1;
+}
+
+static int request_connect(rtcli_request *req) {
+    rtcli_client *client = req->client;
+
+    /* a local cache daemon, if one runs for this server, answers instead;
+     * connecting to it never blocks, a busy daemon is simply skipped */
+    if (cache_daemon_connect(&req->fd, client->server, client->port) == 0) {
+        if (set_nonblocking(req->fd) == 0 &&
+            request_watch(req, EPOLLOUT, EPOLL_CTL_ADD) == 0) {
+            req->state = REQUEST_WRITING;
+            return 0;
+        }
+
+        close(req->fd);
+    }
+    req->fd = -1;
+
+    req->next_addr = client->addrs;
+    return request_connect_next(req);
+}
+
+static rtcli_request *request_new(rtcli_client *client, const char *method, xmlrpc_value *params) {
+    xmlrpc_env env;
+    xmlrpc_mem_block *memblock;
+    rtcli_request *req = NULL;
+
+    xmlrpc_env_init(&env);
+
+    memblock = XMLRPC_MEMBLOCK_NEW(char, &env, 0);
+    if (env.fault_occurred)
+        goto finish;
+
+    xmlrpc_serialize_call(&env, memblock, method, params);
+    if (env.fault_occurred)
+        goto finish;
+
+    req = xmalloc0(sizeof(rtcli_request));
+    req->client = client;
+    req->fd = -1;
+    req->started = trace_now();
+    if (client->timeout)
+        req->deadline = req->started + (uint64_t) client->timeout * 1000000;
+    req->frame = scgi_frame(XMLRPC_MEMBLOCK_CONTENTS(char, memblock),
+                            XMLRPC_MEMBLOCK_SIZE(char, memblock), &req->frame_length);
+
+    if (request_connect(req) < 0) {
+        request_free(req);
+        req = NULL;
+        goto finish;
+    }
+
+    req->next = client->requests;
+    if (client->requests)
+        client->requests->prev = req;
+    client->requests = req;
+    client->pending++;
+
+finish:
+    if (memblock)
+        XMLRPC_MEMBLOCK_FREE(char, memblock);
+    xmlrpc_DECREF(params);
+    xmlrpc_env_clean(&env);
+
+    return req;
+}
+
+/* Submits method with params, which are consumed. Returns -1 if the call
+ * could not even be started, the callback is not run in that case. */
+int rtcli_call(rtcli_client *client, const char *method, xmlrpc_value *params,
+               rtcli_call_cb cb, void *data) {
+    rtcli_request *req;
+
+    assert(client);
+    assert(method);
+    assert(params);
+    assert(cb);
+
+    if (!(req = request_new(client, method, params)))
+        return -1;
+
+    req->call_cb = cb;
+    req->data = data;
+
+    return 0;
+}
+
+/* Hands a decoded row to the caller in the public field layout. */
+static void stream_row(const xmlrpc_stream_field *fields, size_t count, void *data) {
+    rtcli_request *req = data;
+
+    if (count > req->fields_allocated) {
+        req->fields_allocated = count;
+        req->fields = xrealloc(req->fields, sizeof(rtcli_field) * count);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        req->fields[i].type = fields[i].type;
+        req->fields[i].string = fields[i].string;
+        req->fields[i].length = fields[i].length;
+        req->fields[i].i = fields[i].i;
+    }
+
+    req->row_fn(req->fields, count, req->data);
+}
+
+/* Like rtcli_call(), but the reply, a multicall style array of rows, is
+ * decoded while it arrives: row_fn gets each row as soon as it is complete
+ * and cb runs once the reply is over, with any fault in env. Memory stays
+ * bounded by the largest row. */
+int rtcli_call_rows(rtcli_client *client, const char *method, xmlrpc_value *params,
+                    rtcli_row_fn row_fn, rtcli_done_cb cb, void *data) {
+    rtcli_request *req;
+
+    assert(client);
+    assert(method);
+    assert(params);
+    assert(row_fn);
+    assert(cb);
+
+    if (!(req = request_new(client, method, params)))
+        return -1;
+
+    req->stream = xmlrpc_stream_new(stream_row, req);
+    req->row_fn = row_fn;
+    req->done_cb = cb;
+    req->data = data;
+
+    return 0;
+}
+
+int rtcli_list_torrents(rtcli_client *client, rtcli_list_cb cb, void *data) {
+    xmlrpc_env env;
+    xmlrpc_value *params;
+    rtcli_request *req;
+    bool multicall2;
+
+    assert(client);
+    assert(cb);
+
+    multicall2 = client->flags & CAP_D_MULTICALL2;
+
+    xmlrpc_env_init(&env);
+    params = torrent_list_params(&env, multicall2);
+    if (env.fault_occurred) {
+        xmlrpc_env_clean(&env);
+        return -1;
+    }
+    xmlrpc_env_clean(&env);
+
+    if (!(req = request_new(client, torrent_list_method(multicall2), params)))
+        return -1;
+
+    req->list_cb = cb;
+    req->data = data;
+
+    return 0;
+}
+
+static void request_write(rtcli_request *req) {
+    ssize_t n;
+
+    while (req->sent < req->frame_length) {
+        n = send(req->fd, req->frame + req->sent, req->frame_length - req->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                request_finish(req, "Could not send request");
+            return;
+        }
+        req->sent += n;
+    }
+
+    req->state = REQUEST_READING;
+    if (request_watch(req, EPOLLIN, EPOLL_CTL_MOD) < 0)
+        request_finish(req, "Could not send request");
+}
+
+/* Skips the SCGI status headers, then hands everything after them to the
+ * stream. Without a recorder nothing fed is kept. */
+static void feed_stream(rtcli_request *req) {
+    if (!req->body_started) {
+        char *body = strstr(req->reply, "\r\n\r\n");
+
+        if (!body)
+            return;
+
+        req->body_started = true;
+        req->fed = body + 4 - req->reply;
+    }
+
+    xmlrpc_stream_feed(req->stream, req->reply + req->fed, req->reply_length - req->fed);
+    req->fed = req->reply_length;
+
+    if (!req->client->recorder)
+        req->reply_length = req->fed = 0;
+}
+
+static void request_read(rtcli_request *req) {
+    ssize_t n;
+
+    for (;;) {
+        /* one spare byte keeps the reply NUL terminated */
+        if (req->reply_size - req->reply_length < RTCLI_READ_CHUNK + 1) {
+            req->reply_size = req->reply_size * 2 + RTCLI_READ_CHUNK + 1;
+            req->reply = xrealloc(req->reply, req->reply_size);
+        }
+
+        n = recv(req->fd, req->reply + req->reply_length, RTCLI_READ_CHUNK, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                request_finish(req, "No response from server");
+            return;
+        }
+
+        if (n == 0) {
+            request_finish(req, NULL);
+            return;
+        }
+
+        if (req->client->recorder) {
+            req->chunks = xrealloc(req->chunks, sizeof(request_chunk) * (req->nchunks + 1));
+            req->chunks[req->nchunks].at = trace_now();
+            req->chunks[req->nchunks].offset = req->reply_length;
+            req->chunks[req->nchunks].len = n;
+            req->nchunks++;
+        }
+
+        req->reply_length += n;
+        req->reply[req->reply_length] = '\0';
+
+        if (req->stream)
+            feed_stream(req);
+    }
+}
+
+static void request_connected(rtcli_request *req) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(req->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        err = errno;
+
+    if (err == 0) {
+        req->state = REQUEST_WRITING;
+        request_write(req);
+        return;
+    }
+
+    request_close(req);
+    if (request_connect_next(req) < 0)
+        request_finish(req, "Could not connect");
+}
+
+static void request_event(rtcli_request *req, uint32_t events) {
+    switch (req->state) {
+    case REQUEST_CONNECTING:
+        request_connected(req);
+        break;
+    case REQUEST_WRITING:
+        if (events & EPOLLERR)
+            request_finish(req, "Could not send request");
+        else
+            request_write(req);
+        break;
+    case REQUEST_READING:
+        request_read(req);
+        break;
+    }
+}
+
+/* Fails every pending request with the errno of a broken epoll instance,
+ * nothing could complete them anymore. */
+static void client_fail(rtcli_client *client, int err) {
+    const char *message = strerror(err);
+
+    while (client->requests)
+        request_finish(client->requests, message);
+}
+
+/* Milliseconds until the earliest deadline, rounded up, or -1. */
+static int client_deadline(const rtcli_client *client) {
+    uint64_t now, nearest = 0;
+
+    for (rtcli_request *req = client->requests; req; req = req->next) {
+        if (req->deadline && (!nearest || req->deadline < nearest))
+            nearest = req->deadline;
+    }
+
+    if (!nearest)
+        return -1;
+
+    now = trace_now();
+    if (nearest <= now)
+        return 0;
+
+    if ((nearest - now) / 1000000 >= INT_MAX)
+        return INT_MAX;
+
+    return (int) ((nearest - now + 999999) / 1000000);
+}
+
+/* Requests submitted from the callbacks are put in front of the list with
+ * a deadline still ahead, so walking on from next is safe. */
+static void client_expire(rtcli_client *client) {
+    uint64_t now = trace_now();
+    rtcli_request *next;
+
+    for (rtcli_request *req = client->requests; req; req = next) {
+        next = req->next;
+        if (req->deadline && req->deadline <= now)
+            request_finish(req, "Request timed out");
+    }
+}
+
+static int client_process(rtcli_client *client, int timeout) {
+    struct epoll_event events[RTCLI_EVENTS];
+    int n, deadline;
+
+    deadline = client_deadline(client);
+    if (deadline >= 0 && (timeout < 0 || deadline < timeout))
+        timeout = deadline;
+
+    do {
+        n = epoll_wait(client->epfd, events, RTCLI_EVENTS, timeout);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0) {
+            client_fail(client, errno);
+            return -1;
+        }
+
+        for (int i = 0; i < n; ++i)
+            request_event(events[i].data.ptr, events[i].events);
+
+        timeout = 0;
+    } while (n == RTCLI_EVENTS || (n < 0 && errno == EINTR));
+
+    client_expire(client);
+    return 0;
+}
+
+/* How long an embedding event loop may wait on rtcli_client_fd() before
+ * it has to call rtcli_client_dispatch() anyway, in milliseconds. -1 if
+ * no request has a deadline. */
+int rtcli_client_timeout(const rtcli_client *client) {
+    assert(client);
+    return client_deadline(client);
+}
+
+/* Makes whatever progress is possible without blocking. Callbacks must
+ * not free the client. Returns -1 if the client cannot wait for events
+ * anymore, all pending requests have then failed. */
+int rtcli_client_dispatch(rtcli_client *client) {
+    assert(client);
+    return client_process(client, 0);
+}
+
+/* Blocks until every submitted request, including those submitted from
+ * callbacks, has completed. Returns -1 like rtcli_client_dispatch(). */
+int rtcli_client_run(rtcli_client *client) {
+    assert(client);
+
+    while (client->pending > 0) {
+        if (client_process(client, -1) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Requests still in flight are completed with a fault. */
+void rtcli_client_free(rtcli_client *client) {
+    if (!client)
+        return;
+
+    while (client->requests)
+        request_finish(client->requests, "Client closed");
+
+    if (client->addrs)
+        freeaddrinfo(client->addrs);
+
+    close(client->epfd);
+    xfree(client->server);
+    xfree(client->port);
+    xfree(client);
+}
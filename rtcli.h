@@ -0,0 +1,93 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef rtclih
+#define rtclih
+
+/* librtorrentcli: a non-blocking SCGI client for rtorrent.
+ *
+ * Requests are submitted with a callback and run concurrently, each on a
+ * connection of its own. All their sockets are watched by one epoll
+ * instance whose descriptor, rtcli_client_fd(), becomes readable whenever
+ * a request can make progress. Add it to your own event loop and call
+ * rtcli_client_dispatch() when it fires, or once rtcli_client_timeout()
+ * has passed; callbacks run from there.
+ * Nothing but rtcli_client_new(), which resolves the server name, ever
+ * blocks outside rtcli_client_run().
+ *
+ * Callbacks get an env that carries the fault if the request failed. The
+ * result passed to them is only borrowed: take a reference, or keep the
+ * torrent_array by setting *result to NULL, to hold on to it. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xmlrpc-c/base.h>
+
+#include "torrent.h"
+
+/* Bits for rtcli_client_set_capabilities(). A server without d.multicall2
+ * is asked for the torrent list with d.multicall. */
+enum {
+    RTCLI_D_MULTICALL2 = 1 << 0
+};
+
+typedef struct rtcli_client rtcli_client;
+
+/* Recorded exchanges can be served again by rtorrent-cli --replay. */
+struct trace;
+
+/* One scalar of a row, strings are not terminated and only valid during
+ * the callback. Integers of either size end up in i. */
+typedef struct {
+    xmlrpc_type type;
+    const char *string;
+    size_t length;
+    int64_t i;
+} rtcli_field;
+
+typedef void (*rtcli_row_fn)(const rtcli_field *fields, size_t count, void *data);
+
+typedef void (*rtcli_call_cb)(rtcli_client *client, xmlrpc_env *env, xmlrpc_value *result, void *data);
+typedef void (*rtcli_list_cb)(rtcli_client *client, xmlrpc_env *env, torrent_array **result, void *data);
+typedef void (*rtcli_done_cb)(rtcli_client *client, xmlrpc_env *env, void *data);
+
+RTCLI_EXPORT rtcli_client *rtcli_client_new(const char *server, const char *port);
+RTCLI_EXPORT void rtcli_client_free(rtcli_client *client);
+
+RTCLI_EXPORT void rtcli_client_set_capabilities(rtcli_client *client, unsigned int flags);
+RTCLI_EXPORT void rtcli_client_set_threads(rtcli_client *client, unsigned int threads);
+RTCLI_EXPORT void rtcli_client_set_timeout(rtcli_client *client, unsigned int ms);
+RTCLI_EXPORT void rtcli_client_set_trace(rtcli_client *client, struct trace *t);
+
+RTCLI_EXPORT struct trace *rtcli_trace_open(const char *path);
+RTCLI_EXPORT void rtcli_trace_close(struct trace *t);
+
+RTCLI_EXPORT int rtcli_client_fd(const rtcli_client *client);
+RTCLI_EXPORT size_t rtcli_client_pending(const rtcli_client *client);
+RTCLI_EXPORT int rtcli_client_timeout(const rtcli_client *client);
+RTCLI_EXPORT int rtcli_client_dispatch(rtcli_client *client);
+RTCLI_EXPORT int rtcli_client_run(rtcli_client *client);
+
+RTCLI_EXPORT int rtcli_call(rtcli_client *client, const char *method, xmlrpc_value *params,
+               rtcli_call_cb cb, void *data);
+RTCLI_EXPORT int rtcli_call_rows(rtcli_client *client, const char *method, xmlrpc_value *params,
+               rtcli_row_fn row_fn, rtcli_done_cb cb, void *data);
+RTCLI_EXPORT int rtcli_list_torrents(rtcli_client *client, rtcli_list_cb cb, void *data);
+
+#endif
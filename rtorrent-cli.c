@@ -26,25 +26,77 @@
 #include <assert.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/client.h>
 
 #include "util.h"
 #include "xmlrpc_client.h"
+#include "capability.h"
+#include "torrent.h"
+#include "scgi_proxy.h"
+#include "trace.h"
+#include "replay.h"
+#include "cache_daemon.h"
+#include "filetree.h"
+#include "utf8.h"
+#include "placement.h"
+#include "events.h"
+#include "rtcli.h"
 
 #define NAME "rtorrent-cli"
 #define VERSION "0.1"
 
 #define DEFAULT_SERVER "http://localhost/RPC2"
 
+#define RECHECK_TICK_MS 1000
+
 static char *server;
 static char *port = "5000";
 static xmlrpc_env env;
+static capability_set caps;
+static unsigned int threads = 1;
+static char *record_path;
+static char *replay_path;
+static bool max_speed;
+static unsigned int fresh_ms = CACHE_DAEMON_FRESH_MS;
+static const char *torrent_ids;
+static size_t max_checks = 2;
+static long files_id;
+static int files_depth = 2;
+static size_t term_cols;
+static bool place_auto;
+static trace *recorder;
+static rtcli_client *client;
+
+enum {
+    OPT_RECORD = 256,
+    OPT_REPLAY,
+    OPT_MAX_SPEED,
+    OPT_DAEMON,
+    OPT_FRESH,
+    OPT_RECHECK,
+    OPT_MAX_CHECKS,
+    OPT_FILES,
+    OPT_DEPTH,
+    OPT_ADD,
+    OPT_PLACE,
+    OPT_LISTEN
+};
 
 static enum {
     NONE,
     USAGE,
-    LIST
+    LIST,
+    REPLAY,
+    DAEMON,
+    RECHECK,
+    FILES,
+    ADD,
+    LISTEN
 } action = NONE;
 
 static enum {
@@ -53,54 +105,34 @@ static enum {
     HTTP_CONNECTION
 } connection_type = INVALID_CONNECTION;
 
-typedef struct {
-    int64_t id;
-    const char *hash;
-    const char *name;
-    bool complete;
-    bool active;
-    bool started;
-    int64_t size_bytes;
-    int64_t done_bytes;
-    int64_t ratio;
-    int64_t down_total;
-    int64_t up_rate;
-    int64_t down_rate;
-} torrent_info;
-
-typedef struct {
-    torrent_info **torrents;
-    size_t size;
-} torrent_array;
-
-static void torrent_info_free(torrent_info *info) {
-    xfree((char*) info->name);
-    xfree((char*) info->hash);
-    xfree(info);
-}
-
-static torrent_array *torrent_array_new(size_t size) {
-    torrent_array *array = xmalloc(sizeof(torrent_array));
-
-    array->torrents = xmalloc(sizeof(torrent_info*)*size);
-
-    for (size_t i = 0; i < size; ++i) {
-        array->torrents[i] = xmalloc0(sizeof(torrent_info));
-    }
-    array->size = size;
-    return array;
-}
-
-static void torrent_array_free(torrent_array *array) {
-    for (size_t i = 0; i < array->size; ++i) {
-        torrent_info_free(array->torrents[i]);
-    }
-    xfree(array->torrents);
-    xfree(array);
-}
-
 static void usage() {
-    printf("usage bla \n");
+    printf("usage: " NAME " [URL] ACTION [OPTIONS]\n"
+           "\n"
+           "URL is http://HOST[/RPC2] for XML-RPC over HTTP, or a HOST that speaks\n"
+           "SCGI on port 5000. It defaults to " DEFAULT_SERVER ".\n"
+           "\n"
+           "Actions:\n"
+           "  -l, --list            list all torrents\n"
+           "      --files ID        show the directory tree of torrent ID\n"
+           "      --recheck         hash check the torrents chosen with -t\n"
+           "      --add FILE...     load torrent files and start them (SCGI)\n"
+           "      --listen          print download events as they happen (SCGI,\n"
+           "                        rtorrent must run on this host as this user)\n"
+           "      --daemon          serve cached replies to local clients (SCGI)\n"
+           "      --replay TRACE    answer on HOST from a recorded trace\n"
+           "  -h, --help            show this help\n"
+           "\n"
+           "Options:\n"
+           "  -j, --threads N       decode large lists on N threads (default: CPUs)\n"
+           "  -t, --torrent IDS     torrents for --recheck: 1,4-7 or all\n"
+           "      --max-checks N    hash checks run at once by --recheck (default: 2)\n"
+           "      --depth N         directory levels --files shows, 0 for all (default: 2)\n"
+           "      --place auto      spread --add over the least loaded endpoints\n"
+           "                        listed in $XDG_CONFIG_HOME/rtorrent-cli/endpoints\n"
+           "      --fresh MS        how long --daemon reuses a reply (default: %d)\n"
+           "      --record TRACE    record every SCGI exchange to TRACE\n"
+           "      --max-speed       replay without the recorded pauses\n",
+           CACHE_DAEMON_FRESH_MS);
     exit(0);
 }
 
@@ -139,156 +171,181 @@ static void parse_url(char **argv, int *argc, char **url) {
 
 }
 
-static void execute_method(xmlrpc_value **result, char *method, xmlrpc_value *params) {
+static xmlrpc_value *execute_method(xmlrpc_env *e, const char *method, xmlrpc_value *params) {
     xmlrpc_server_info *serverInfo;
+    xmlrpc_value *result = NULL;
 
-    xmlrpc_client_init2(&env, XMLRPC_CLIENT_NO_FLAGS, NAME, VERSION, NULL, 0);
-    check_fault();
+    xmlrpc_client_init2(e, XMLRPC_CLIENT_NO_FLAGS, NAME, VERSION, NULL, 0);
+    if (e->fault_occurred)
+        return NULL;
 
-    serverInfo = xmlrpc_server_info_new(&env, server);
-    *result = xmlrpc_client_call_server_params(&env, serverInfo, method, params);
-    check_fault();
+    serverInfo = xmlrpc_server_info_new(e, server);
+    if (!e->fault_occurred) {
+        result = xmlrpc_client_call_server_params(e, serverInfo, method, params);
+        xmlrpc_server_info_free(serverInfo);
+    }
 
-    xmlrpc_server_info_free(serverInfo);
     xmlrpc_client_cleanup();
+    return result;
 }
 
-static void execute_proxy_method(xmlrpc_value **result, char *method, xmlrpc_value *params) {
-    *result = xmlrpc_call_scgi_server_params(&env, server, port, method, params);
-    check_fault();
-}
+/* SCGI calls all go through one rtcli client, made on first use. */
+static rtcli_client *get_client() {
+    if (!client) {
+        if (!(client = rtcli_client_new(server, port))) {
+            fprintf(stderr, "ERROR: Could not resolve %s:%s\n", server, port);
+            exit(1);
+        }
+        rtcli_client_set_threads(client, threads);
+        rtcli_client_set_trace(client, recorder);
+    }
 
-static void get_string(xmlrpc_value *value, const char **string) {
-    assert(xmlrpc_value_type(value) == XMLRPC_TYPE_STRING);
-    xmlrpc_read_string(&env, value, string);
-    check_fault();
+    rtcli_client_set_capabilities(client, caps.flags);
+    return client;
 }
 
-static void get_int64(xmlrpc_value *value, int64_t *num) {
-    xmlrpc_int64 tmp;
-    assert(xmlrpc_value_type(value) == XMLRPC_TYPE_I8);
-    xmlrpc_read_i8(&env, value, &tmp);
-    check_fault();
+typedef struct {
+    xmlrpc_env *env;
+    xmlrpc_value *result;
+} proxy_call;
 
-    *num = (int64_t) tmp;
-}
+static void proxy_done(rtcli_client *c, xmlrpc_env *e, xmlrpc_value *result, void *data) {
+    proxy_call *call = data;
 
-static void get_bool_from_int64(xmlrpc_value *value, bool *result) {
-    int64_t tmp;
-    get_int64(value, &tmp);
-    *result = tmp == 1 ? true : false;
-}
+    (void) c;
 
-static void prepare_list_params(xmlrpc_value **params) {
-    xmlrpc_value *tmp;
-    const char **p;
-    const char *arguments[] = { "main", "d.hash=", "d.name=", "d.is_active=",
-                                "d.state=", "d.bytes_done=", "d.size_bytes=",
-                                "d.up.rate=", "d.down.rate=", "d.down.total=",
-                                "d.ratio=", "d.complete=", NULL };
+    if (e->fault_occurred) {
+        xmlrpc_env_set_fault(call->env, e->fault_code, e->fault_string);
+        return;
+    }
 
-    *params = xmlrpc_array_new(&env);
-    check_fault();
-    p = arguments;
+    xmlrpc_INCREF(result);
+    call->result = result;
+}
 
-    while (*p) {
-        xmlrpc_array_append_item(&env, *params, tmp = xmlrpc_string_new(&env, *p));
-        check_fault();
-        xmlrpc_DECREF(tmp);
-        p++;
+static xmlrpc_value *execute_proxy_method(xmlrpc_env *e, const char *method, xmlrpc_value *params) {
+    proxy_call call = { e, NULL };
+
+    if (rtcli_call(get_client(), method, params, proxy_done, &call) < 0) {
+        xmlrpc_env_set_fault(e, -32300, "Could not connect to server");
+        return NULL;
     }
-}
 
-static void get_torrent_list(torrent_array **result) {
-    size_t size;
-    xmlrpc_value *xml_array, *params;
+    rtcli_client_run(client);
+    return call.result;
+}
 
-    prepare_list_params(&params);
+/* Calls method and consumes params, any fault is left in e. */
+static xmlrpc_value *try_call(xmlrpc_env *e, const char *method, xmlrpc_value *params) {
+    xmlrpc_value *result = NULL;
 
     switch (connection_type) {
         case HTTP_CONNECTION:
-            execute_method(&xml_array, "d.multicall", params);
+            result = execute_method(e, method, params);
+            xmlrpc_DECREF(params);
             break;
         case SCGI_CONNECTION:
-            execute_proxy_method(&xml_array, "d.multicall", params);
+            result = execute_proxy_method(e, method, params);
             break;
         default:
             assert_not_reached();
             break;
     }
 
+    return result;
+}
+
+static void call_method(xmlrpc_value **result, const char *method, xmlrpc_value *params) {
+    *result = try_call(&env, method, params);
     check_fault();
-    assert(xmlrpc_value_type(xml_array) == XMLRPC_TYPE_ARRAY);
+}
 
-    XMLRPC_ASSERT_ARRAY_OK(xml_array);
-    size = xmlrpc_array_size(&env, xml_array);
+static char *endpoint_name() {
+    char *endpoint;
+
+    if (connection_type != SCGI_CONNECTION)
+        return xstrdup(server);
+
+    endpoint = xmalloc(strlen(server)+strlen(port)+2);
+    sprintf(endpoint, "%s:%s", server, port);
+    return endpoint;
+}
+
+static void probe_capabilities() {
+    xmlrpc_value *params, *result;
+    const char *version;
+
+    params = xmlrpc_array_new(&env);
     check_fault();
+    call_method(&result, "system.listMethods", params);
 
-    if (size <= 0)
-        goto finish;
+    capability_from_methods(&env, result, &caps);
+    check_fault();
+    xmlrpc_DECREF(result);
 
-    *result = torrent_array_new(size);
-    for (size_t i = 0; i < size; ++i) {
-        size_t tarray_size;
-        xmlrpc_value *tarray = NULL;
+    params = xmlrpc_array_new(&env);
+    check_fault();
+    call_method(&result, "system.client_version", params);
 
-        xmlrpc_array_read_item(&env, xml_array, i, &tarray);
-        check_fault();
-        assert(xmlrpc_value_type(tarray) == XMLRPC_TYPE_ARRAY);
+    xmlrpc_get_string(&env, result, &version);
+    check_fault();
+    snprintf(caps.version, sizeof(caps.version), "%s", version);
+    xfree((char*) version);
+    xmlrpc_DECREF(result);
 
-        XMLRPC_ASSERT_ARRAY_OK(tarray);
-        tarray_size = xmlrpc_array_size(&env, tarray);
+    caps.probed = time(NULL);
+}
 
-        (*result)->torrents[i]->id = i+1;
-        for (size_t j = 0; j < tarray_size; ++j) {
-            xmlrpc_value *item = NULL;
+/* Probing costs two round trips, so the result is kept on disk and only
+ * refreshed once it is older than CAPABILITY_TTL. */
+static void load_capabilities() {
+    char *endpoint = endpoint_name();
 
-            xmlrpc_array_read_item(&env, tarray, j, &item);
-            check_fault();
+    if (!capability_load(endpoint, &caps)) {
+        probe_capabilities();
+        capability_store(endpoint, &caps);
+    }
 
-            switch (j) {
-                case 0:
-                    get_string(item, &(*result)->torrents[i]->hash);
-                    break;
-                case 1:
-                    get_string(item, &(*result)->torrents[i]->name);
-                    break;
-                case 2:
-                    get_bool_from_int64(item, &(*result)->torrents[i]->active);
-                    break;
-                case 3:
-                    get_bool_from_int64(item, &(*result)->torrents[i]->started);
-                    break;
-                case 4:
-                    get_int64(item, &(*result)->torrents[i]->done_bytes);
-                    break;
-                case 5:
-                    get_int64(item, &(*result)->torrents[i]->size_bytes);
-                    break;
-                case 6:
-                    get_int64(item, &(*result)->torrents[i]->up_rate);
-                    break;
-                case 7:
-                    get_int64(item, &(*result)->torrents[i]->down_rate);
-                    break;
-                case 8:
-                    get_int64(item, &(*result)->torrents[i]->down_total);
-                    break;
-                case 9:
-                    get_int64(item, &(*result)->torrents[i]->ratio);
-                    break;
-                case 10:
-                    get_bool_from_int64(item, &(*result)->torrents[i]->complete);
-                    break;
-                default:
-                    ;
-            }
-            xmlrpc_DECREF(item);
-        }
-        xmlrpc_DECREF(tarray);
+    xfree(endpoint);
+}
+
+static void list_done(rtcli_client *c, xmlrpc_env *e, torrent_array **result, void *data) {
+    (void) c;
+
+    if (e->fault_occurred) {
+        xmlrpc_env_set_fault(&env, e->fault_code, e->fault_string);
+        return;
     }
 
-finish:
+    /* take the array over, rtcli frees whatever is left behind */
+    *(torrent_array**) data = *result;
+    *result = NULL;
+}
+
+static void get_torrent_list(torrent_array **result) {
+    xmlrpc_value *xml_array, *params;
+    bool multicall2;
+
+    load_capabilities();
+
+    if (connection_type == SCGI_CONNECTION) {
+        *result = NULL;
+        if (rtcli_list_torrents(get_client(), list_done, result) < 0)
+            xmlrpc_env_set_fault(&env, -32300, "Could not connect to server");
+        check_fault();
+
+        rtcli_client_run(client);
+        check_fault();
+        return;
+    }
+
+    multicall2 = caps.flags & CAP_D_MULTICALL2;
+    params = torrent_list_params(&env, multicall2);
+    check_fault();
+    call_method(&xml_array, torrent_list_method(multicall2), params);
+
+    torrent_decode_list(&env, xml_array, result);
+    check_fault();
     xmlrpc_DECREF(xml_array);
 }
 
@@ -307,23 +364,40 @@ static void eta_to_string(char *buf, size_t  buflen, int64_t eta) {
         snprintf(buf, buflen, "Inf");
 }
 
-static void byte_to_string(char *buf, size_t buflen, int64_t byte) {
-    if (byte < (1 << 10))
-        snprintf(buf, buflen, "%" PRId64 "B", byte);
-    else if (byte < (1 << 20))
-        snprintf(buf, buflen, "%.1fKiB", (double) byte / (1 << 10));
-    else if (byte < (1 << 30))
-        snprintf(buf, buflen, "%.1fMiB", (double) byte / (1 << 20));
-    else if (byte < (1L << 40))
-        snprintf(buf, buflen, "%.1fGiB", (double) byte / (1L << 30));
-    else if (byte < (1L << 50))
-        snprintf(buf, buflen, "%.1fTiB", (double) byte / (1LL << 40));
-    else
-        snprintf(buf, buflen, "Inf");
+/* Returns the width of the terminal on stdout, or 0 if stdout is not a
+ * terminal and lines should not be cut. */
+static size_t terminal_columns() {
+    struct winsize ws;
+    const char *columns;
+
+    if (!isatty(STDOUT_FILENO))
+        return 0;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        return ws.ws_col;
+
+    if ((columns = getenv("COLUMNS")))
+        return (size_t) strtoul(columns, NULL, 10);
+
+    return 0;
+}
+
+/* Prints the name into whatever is left of the line after `used`
+ * columns, counting display width rather than bytes. */
+static void print_name(const char *name, int used) {
+    size_t max_cols = SIZE_MAX;
+    utf8_span span;
+
+    if (term_cols > 0)
+        max_cols = term_cols > (size_t) used + 1 ? term_cols - used : 1;
+
+    utf8_fit(name, strlen(name), max_cols, &span);
+    utf8_print(stdout, name, &span, 0);
+    putchar('\n');
 }
 
 static void print_torrent(torrent_info *info) {
-    int done;
+    int done, used;
     int64_t eta;
     double ratio;
     char status[20], etastr[20], up_rate[20], down_rate[20], have[20];
@@ -347,9 +421,10 @@ static void print_torrent(torrent_info *info) {
     else
         strcpy(status, "Active");
 
-    printf("%4" PRId64 ". %4d%% %9s  %-8s  %8s  %8s %8.2f   %-11s  %s\n",
-           info->id, done, have, etastr, up_rate, down_rate,
-           ratio, status, info->name);
+    used = printf("%4" PRId64 ". %4d%% %9s  %-8s  %8s  %8s %8.2f   %-11s  ",
+                  info->id, done, have, etastr, up_rate, down_rate,
+                  ratio, status);
+    print_name(info->name, used);
 }
 
 static void list_torrents() {
@@ -361,6 +436,7 @@ static void list_torrents() {
     if (tarray == NULL)
         return;
 
+    term_cols = terminal_columns();
     printf("%-4s   %-4s  %8s  %-8s  %8s  %8s %9s  %-11s  %s\n",
             "ID", "Done", "Have", "ETA", "Up", "Down", "Ratio", "Status", "Name");
     for (size_t i = 0; i < tarray->size; ++i) {
@@ -379,12 +455,522 @@ static void list_torrents() {
     torrent_array_free(tarray);
 }
 
+/* Parses an ID list as printed by --list, e.g. "1,4-7" or "all". */
+static bool parse_id_list(const char *spec, size_t count, bool *selected) {
+    const char *p = spec;
+
+    if (strcmp(spec, "all") == 0) {
+        for (size_t i = 0; i < count; ++i)
+            selected[i] = true;
+        return true;
+    }
+
+    while (*p) {
+        char *end;
+        long first, last;
+
+        first = last = strtol(p, &end, 10);
+        if (end == p)
+            return false;
+
+        if (*end == '-') {
+            p = end+1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+        }
+
+        if (first < 1 || last < first || (size_t) last > count)
+            return false;
+
+        for (long id = first; id <= last; ++id)
+            selected[id-1] = true;
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return false;
+        p = end;
+    }
+
+    return true;
+}
+
+static xmlrpc_value *hash_call(const char *method, const char *hash) {
+    xmlrpc_value *call, *params, *tmp;
+
+    call = xmlrpc_struct_new(&env);
+    check_fault();
+
+    xmlrpc_struct_set_value(&env, call, "methodName", tmp = xmlrpc_string_new(&env, method));
+    check_fault();
+    xmlrpc_DECREF(tmp);
+
+    params = xmlrpc_array_new(&env);
+    check_fault();
+    xmlrpc_array_append_item(&env, params, tmp = xmlrpc_string_new(&env, hash));
+    check_fault();
+    xmlrpc_DECREF(tmp);
+
+    xmlrpc_struct_set_value(&env, call, "params", params);
+    check_fault();
+    xmlrpc_DECREF(params);
+
+    return call;
+}
+
+/* Builds the {faultCode, faultString} struct system.multicall uses for a
+ * failed call. */
+static xmlrpc_value *fault_struct(const xmlrpc_env *fault) {
+    xmlrpc_value *result, *tmp;
+
+    result = xmlrpc_struct_new(&env);
+    check_fault();
+
+    xmlrpc_struct_set_value(&env, result, "faultCode", tmp = xmlrpc_int_new(&env, fault->fault_code));
+    check_fault();
+    xmlrpc_DECREF(tmp);
+    xmlrpc_struct_set_value(&env, result, "faultString", tmp = xmlrpc_string_new(&env, fault->fault_string));
+    check_fault();
+    xmlrpc_DECREF(tmp);
+
+    return result;
+}
+
+/* Runs a list of {methodName, params} structs in one system.multicall
+ * round trip, or one call at a time on servers without it. Either way
+ * every result comes back wrapped in a one element array, or as a
+ * {faultCode, faultString} struct if that call failed. */
+static void batch_call(xmlrpc_value *calls, xmlrpc_value **results) {
+    xmlrpc_value *params;
+    int size;
+
+    if (caps.flags & CAP_SYSTEM_MULTICALL) {
+        params = xmlrpc_array_new(&env);
+        check_fault();
+        xmlrpc_array_append_item(&env, params, calls);
+        check_fault();
+
+        call_method(results, "system.multicall", params);
+        return;
+    }
+
+    *results = xmlrpc_array_new(&env);
+    check_fault();
+    size = xmlrpc_array_size(&env, calls);
+    check_fault();
+
+    for (int i = 0; i < size; ++i) {
+        xmlrpc_value *call, *method, *call_params, *result, *wrapped;
+        xmlrpc_env call_env;
+        const char *name;
+
+        xmlrpc_array_read_item(&env, calls, i, &call);
+        check_fault();
+        xmlrpc_struct_find_value(&env, call, "methodName", &method);
+        check_fault();
+        xmlrpc_struct_find_value(&env, call, "params", &call_params);
+        check_fault();
+
+        xmlrpc_get_string(&env, method, &name);
+        check_fault();
+
+        xmlrpc_env_init(&call_env);
+        result = try_call(&call_env, name, call_params);
+
+        if (call_env.fault_occurred)
+            wrapped = fault_struct(&call_env);
+        else {
+            wrapped = xmlrpc_array_new(&env);
+            check_fault();
+            xmlrpc_array_append_item(&env, wrapped, result);
+            check_fault();
+            xmlrpc_DECREF(result);
+        }
+        xmlrpc_array_append_item(&env, *results, wrapped);
+        check_fault();
+
+        xmlrpc_DECREF(wrapped);
+        xmlrpc_env_clean(&call_env);
+        xmlrpc_DECREF(method);
+        xmlrpc_DECREF(call);
+        xfree((char*) name);
+    }
+}
+
+/* Reads the integer call i of a batch returned. Returns false if that
+ * call failed or did not answer with an integer. */
+static bool batch_result_int64(xmlrpc_value *results, size_t i, int64_t *num) {
+    xmlrpc_value *wrapped, *item;
+    xmlrpc_env e;
+    bool ok;
+
+    xmlrpc_array_read_item(&env, results, i, &wrapped);
+    check_fault();
+
+    if (xmlrpc_value_type(wrapped) != XMLRPC_TYPE_ARRAY) {
+        xmlrpc_DECREF(wrapped);
+        return false;
+    }
+
+    xmlrpc_env_init(&e);
+    xmlrpc_array_read_item(&e, wrapped, 0, &item);
+    if (!e.fault_occurred) {
+        xmlrpc_get_int64(&e, item, num);
+        xmlrpc_DECREF(item);
+    }
+    ok = !e.fault_occurred;
+
+    xmlrpc_env_clean(&e);
+    xmlrpc_DECREF(wrapped);
+    return ok;
+}
+
+static void sleep_ms(unsigned int ms) {
+    struct timespec ts = { ms / 1000, (long) (ms % 1000) * 1000000 };
+
+    nanosleep(&ts, NULL);
+}
+
+/* Returns the fault string of call i of a batch, or NULL if it
+ * succeeded. */
+static char *batch_result_fault(xmlrpc_value *results, size_t i) {
+    xmlrpc_value *wrapped, *item = NULL;
+    const char *message = NULL;
+
+    xmlrpc_array_read_item(&env, results, i, &wrapped);
+    check_fault();
+
+    if (xmlrpc_value_type(wrapped) == XMLRPC_TYPE_ARRAY) {
+        xmlrpc_DECREF(wrapped);
+        return NULL;
+    }
+
+    if (xmlrpc_value_type(wrapped) == XMLRPC_TYPE_STRUCT) {
+        xmlrpc_struct_find_value(&env, wrapped, "faultString", &item);
+        check_fault();
+    }
+    if (item && xmlrpc_value_type(item) == XMLRPC_TYPE_STRING) {
+        xmlrpc_get_string(&env, item, &message);
+        check_fault();
+    }
+
+    if (item)
+        xmlrpc_DECREF(item);
+    xmlrpc_DECREF(wrapped);
+
+    return message ? (char*) message : xstrdup("Call failed");
+}
+
+/* Starts hash checks on the given torrents. Those that did start are
+ * appended to running, the others are reported and only counted in
+ * failed, so they never show up as verified bytes. */
+static void start_checks(torrent_array *tarray, const size_t *ids, size_t count,
+                         size_t *running, size_t *nrunning, size_t *failed) {
+    xmlrpc_value *calls, *results, *tmp;
+
+    calls = xmlrpc_array_new(&env);
+    check_fault();
+
+    for (size_t i = 0; i < count; ++i) {
+        xmlrpc_array_append_item(&env, calls, tmp = hash_call("d.check_hash", tarray->torrents[ids[i]]->hash));
+        check_fault();
+        xmlrpc_DECREF(tmp);
+    }
+
+    batch_call(calls, &results);
+
+    for (size_t i = 0; i < count; ++i) {
+        char *fault = batch_result_fault(results, i);
+
+        if (!fault) {
+            running[(*nrunning)++] = ids[i];
+            continue;
+        }
+
+        fprintf(stderr, "%sERROR: Could not check %s: %s\n", isatty(STDOUT_FILENO) ? "\n" : "",
+                tarray->torrents[ids[i]]->name, fault);
+        (*failed)++;
+        xfree(fault);
+    }
+
+    xmlrpc_DECREF(results);
+    xmlrpc_DECREF(calls);
+}
+
+/* Asks for d.hashing, d.chunks_hashed and d.chunk_size of every running
+ * check in a single batch. Finished checks are dropped from `running`
+ * and their size added to `verified`; the bytes hashed so far by the
+ * remaining ones are returned. A check that can no longer be followed,
+ * say because its torrent was erased, is reported and counted in
+ * `failed` while the others carry on. */
+static int64_t poll_checks(torrent_array *tarray, size_t *running, size_t *nrunning,
+                           int64_t *verified, size_t *failed) {
+    static const char *methods[] = { "d.hashing", "d.chunks_hashed", "d.chunk_size" };
+    xmlrpc_value *calls, *results, *tmp;
+    int64_t partial = 0;
+    size_t kept = 0;
+
+    calls = xmlrpc_array_new(&env);
+    check_fault();
+
+    for (size_t i = 0; i < *nrunning; ++i)
+        for (size_t m = 0; m < 3; ++m) {
+            xmlrpc_array_append_item(&env, calls, tmp = hash_call(methods[m], tarray->torrents[running[i]]->hash));
+            check_fault();
+            xmlrpc_DECREF(tmp);
+        }
+
+    batch_call(calls, &results);
+
+    for (size_t i = 0; i < *nrunning; ++i) {
+        int64_t hashing = 0, chunks = 0, chunk_size = 0;
+
+        if (!batch_result_int64(results, i*3, &hashing) ||
+            !batch_result_int64(results, i*3+1, &chunks) ||
+            !batch_result_int64(results, i*3+2, &chunk_size)) {
+            char *fault = NULL;
+
+            for (size_t m = 0; m < 3 && !fault; ++m)
+                fault = batch_result_fault(results, i*3+m);
+
+            fprintf(stderr, "%sERROR: Lost the check of %s: %s\n", isatty(STDOUT_FILENO) ? "\n" : "",
+                    tarray->torrents[running[i]]->name, fault ? fault : "Unexpected reply");
+            (*failed)++;
+            xfree(fault);
+            continue;
+        }
+
+        if (hashing == 0) {
+            *verified += tarray->torrents[running[i]]->size_bytes;
+            continue;
+        }
+
+        partial += chunks * chunk_size;
+        running[kept++] = running[i];
+    }
+    *nrunning = kept;
+
+    xmlrpc_DECREF(results);
+    xmlrpc_DECREF(calls);
+
+    return partial;
+}
+
+static void recheck_torrents() {
+    torrent_array *tarray = NULL;
+    size_t *queue, *running, nqueue = 0, next = 0, nrunning = 0, failed = 0;
+    int64_t verified = 0, partial = 0;
+    uint64_t started;
+    bool *selected, tty = isatty(STDOUT_FILENO);
+    char verifiedstr[20];
+    double elapsed;
+
+    get_torrent_list(&tarray);
+    if (tarray == NULL)
+        return;
+
+    selected = xmalloc0(sizeof(bool) * tarray->size);
+    if (!torrent_ids || !parse_id_list(torrent_ids, tarray->size, selected)) {
+        fprintf(stderr, "ERROR: --recheck needs a valid -t ID list\n");
+        exit(1);
+    }
+
+    queue = xmalloc(sizeof(size_t) * tarray->size);
+    running = xmalloc(sizeof(size_t) * max_checks);
+    for (size_t i = 0; i < tarray->size; ++i)
+        if (selected[i])
+            queue[nqueue++] = i;
+
+    started = trace_now();
+
+    while (next < nqueue || nrunning > 0) {
+        size_t free_slots = max_checks - nrunning;
+
+        if (free_slots > nqueue - next)
+            free_slots = nqueue - next;
+
+        if (free_slots > 0) {
+            start_checks(tarray, queue+next, free_slots, running, &nrunning, &failed);
+            next += free_slots;
+        }
+
+        if (nrunning == 0)
+            continue;
+
+        sleep_ms(RECHECK_TICK_MS);
+        partial = poll_checks(tarray, running, &nrunning, &verified, &failed);
+
+        elapsed = (double) (trace_now() - started) / 1e9;
+        byte_to_string(verifiedstr, 20, verified + partial);
+        printf("%sChecked %zu/%zu, %zu running, %zu failed, %s verified, %.2f GiB/s%s",
+               tty ? "\r" : "", next - nrunning - failed, nqueue, nrunning, failed, verifiedstr,
+               (double) (verified + partial) / (1L << 30) / elapsed, tty ? "" : "\n");
+        fflush(stdout);
+    }
+
+    if (tty)
+        printf("\n");
+
+    xfree(running);
+    xfree(queue);
+    xfree(selected);
+    torrent_array_free(tarray);
+}
+
+/* Looks up hash and name of a torrent by the ID --list shows for it.
+ * IDs are positions in the listing, so it is resolved with the very same
+ * query, which the cache daemon can answer as well. */
+static void get_torrent_ref(long id, const char **hash, const char **name) {
+    torrent_array *tarray = NULL;
+    torrent_info *info;
+
+    get_torrent_list(&tarray);
+    if (!tarray || id < 1 || (size_t) id > tarray->size) {
+        fprintf(stderr, "ERROR: No torrent with ID %ld\n", id);
+        exit(1);
+    }
+
+    info = tarray->torrents[id-1];
+    *hash = xstrdup(info->hash);
+    *name = xstrdup(info->name);
+
+    torrent_array_free(tarray);
+}
+
+static void add_file_row(const rtcli_field *fields, size_t count, void *data) {
+    int64_t size, size_chunks, completed, done;
+
+    if (count < 5 || fields[0].type != XMLRPC_TYPE_STRING)
+        return;
+
+    size = fields[1].i;
+    size_chunks = fields[2].i;
+    completed = fields[3].i;
+
+    if (size_chunks <= 0 || completed >= size_chunks)
+        done = size;
+    else
+        done = (int64_t) ((double) size * completed / size_chunks);
+
+    filetree_add(data, fields[0].string, fields[0].length, size, done, (int) fields[4].i);
+}
+
+static void files_done(rtcli_client *c, xmlrpc_env *e, void *data) {
+    (void) c;
+    (void) data;
+
+    if (e->fault_occurred)
+        xmlrpc_env_set_fault(&env, e->fault_code, e->fault_string);
+}
+
+/* The HTTP transport has no streaming interface, so its reply is parsed
+ * as a whole and then fed through the same row handler. */
+static void add_file_rows(xmlrpc_value *xml_array, filetree *tree) {
+    rtcli_field fields[5];
+    int size;
+
+    size = xmlrpc_array_size(&env, xml_array);
+    check_fault();
+
+    for (int i = 0; i < size; ++i) {
+        xmlrpc_value *row;
+
+        xmlrpc_array_read_item(&env, xml_array, i, &row);
+        check_fault();
+
+        for (int j = 0; j < 5; ++j) {
+            xmlrpc_value *item;
+
+            xmlrpc_array_read_item(&env, row, j, &item);
+            check_fault();
+
+            fields[j].type = xmlrpc_value_type(item);
+            if (j == 0) {
+                xmlrpc_get_string(&env, item, &fields[j].string);
+                fields[j].length = strlen(fields[j].string);
+            } else
+                xmlrpc_get_int64(&env, item, &fields[j].i);
+            check_fault();
+
+            xmlrpc_DECREF(item);
+        }
+
+        add_file_row(fields, 5, tree);
+        xfree((char*) fields[0].string);
+        xmlrpc_DECREF(row);
+    }
+}
+
+static void list_files() {
+    xmlrpc_value *params, *tmp;
+    const char *hash, *name, **p;
+    const char *arguments[] = { "", "f.path=", "f.size_bytes=", "f.size_chunks=",
+                                "f.completed_chunks=", "f.priority=", NULL };
+    filetree *tree;
+
+    get_torrent_ref(files_id, &hash, &name);
+
+    params = xmlrpc_array_new(&env);
+    check_fault();
+    xmlrpc_array_append_item(&env, params, tmp = xmlrpc_string_new(&env, hash));
+    check_fault();
+    xmlrpc_DECREF(tmp);
+    for (p = arguments; *p; ++p) {
+        xmlrpc_array_append_item(&env, params, tmp = xmlrpc_string_new(&env, *p));
+        check_fault();
+        xmlrpc_DECREF(tmp);
+    }
+
+    tree = filetree_new(name);
+
+    if (connection_type == SCGI_CONNECTION) {
+        if (rtcli_call_rows(get_client(), "f.multicall", params, add_file_row, files_done, tree) < 0)
+            xmlrpc_env_set_fault(&env, -32300, "Could not connect to server");
+        check_fault();
+
+        rtcli_client_run(client);
+        check_fault();
+    } else {
+        xmlrpc_value *xml_array;
+
+        call_method(&xml_array, "f.multicall", params);
+        add_file_rows(xml_array, tree);
+        xmlrpc_DECREF(xml_array);
+    }
+
+    filetree_print(tree, files_depth, terminal_columns());
+
+    filetree_free(tree);
+    xfree((char*) name);
+    xfree((char*) hash);
+}
+
 int main(int argc, char *argv[]) {
     static const struct option opts[] = {
         { "list", no_argument, 0, 'l' },
         { "help", no_argument, 0, 'h' },
+        { "threads", required_argument, 0, 'j' },
+        { "record", required_argument, 0, OPT_RECORD },
+        { "replay", required_argument, 0, OPT_REPLAY },
+        { "max-speed", no_argument, 0, OPT_MAX_SPEED },
+        { "daemon", no_argument, 0, OPT_DAEMON },
+        { "fresh", required_argument, 0, OPT_FRESH },
+        { "torrent", required_argument, 0, 't' },
+        { "recheck", no_argument, 0, OPT_RECHECK },
+        { "max-checks", required_argument, 0, OPT_MAX_CHECKS },
+        { "files", required_argument, 0, OPT_FILES },
+        { "depth", required_argument, 0, OPT_DEPTH },
+        { "add", no_argument, 0, OPT_ADD },
+        { "place", required_argument, 0, OPT_PLACE },
+        { "listen", no_argument, 0, OPT_LISTEN },
         { 0, 0, 0, 0 },
     };
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int ret = 0;
+
+    if (ncpu > 1)
+        threads = (unsigned int) ncpu;
 
     if (argc < 2) {
         usage();
@@ -394,7 +980,7 @@ int main(int argc, char *argv[]) {
     parse_url(argv, &argc, &server);
 
     for (;;) {
-        int opt = getopt_long(argc, argv, "lh", opts, NULL);
+        int opt = getopt_long(argc, argv, "lhj:t:", opts, NULL);
         if (opt == -1)
             break;
 
@@ -405,23 +991,172 @@ int main(int argc, char *argv[]) {
             case 'l':
                 action = action == NONE ? LIST : USAGE;
                 break;
+            case 'j': {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+
+                if (*end != '\0' || n < 1 || n > 1024) {
+                    usage();
+                    goto quit;
+                }
+                threads = (unsigned int) n;
+                break;
+            }
+            case OPT_RECORD:
+                record_path = optarg;
+                break;
+            case OPT_REPLAY:
+                replay_path = optarg;
+                action = action == NONE ? REPLAY : USAGE;
+                break;
+            case OPT_MAX_SPEED:
+                max_speed = true;
+                break;
+            case OPT_DAEMON:
+                action = action == NONE ? DAEMON : USAGE;
+                break;
+            case OPT_FRESH: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+
+                if (*end != '\0' || n < 0 || n > 60 * 60 * 1000) {
+                    usage();
+                    goto quit;
+                }
+                fresh_ms = (unsigned int) n;
+                break;
+            }
+            case 't':
+                torrent_ids = optarg;
+                break;
+            case OPT_RECHECK:
+                action = action == NONE ? RECHECK : USAGE;
+                break;
+            case OPT_MAX_CHECKS: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+
+                if (*end != '\0' || n < 1 || n > 1024) {
+                    usage();
+                    goto quit;
+                }
+                max_checks = (size_t) n;
+                break;
+            }
+            case OPT_FILES: {
+                char *end;
+
+                files_id = strtol(optarg, &end, 10);
+                if (*end != '\0' || files_id < 1) {
+                    usage();
+                    goto quit;
+                }
+                action = action == NONE ? FILES : USAGE;
+                break;
+            }
+            case OPT_DEPTH: {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+
+                if (*end != '\0' || n < 0 || n > INT_MAX) {
+                    usage();
+                    goto quit;
+                }
+                files_depth = (int) n;
+                break;
+            }
+            case OPT_ADD:
+                action = action == NONE ? ADD : USAGE;
+                break;
+            case OPT_PLACE:
+                if (strcmp(optarg, "auto") != 0) {
+                    usage();
+                    goto quit;
+                }
+                place_auto = true;
+                break;
+            case OPT_LISTEN:
+                action = action == NONE ? LISTEN : USAGE;
+                break;
             default:
                 usage();
                 goto quit;
         }
     }
 
+    if (record_path) {
+        if (connection_type != SCGI_CONNECTION) {
+            fprintf(stderr, "ERROR: Only SCGI connections can be recorded\n");
+            ret = 1;
+            goto quit;
+        }
+
+        if (!(recorder = trace_open(record_path))) {
+            fprintf(stderr, "ERROR: Could not open %s for recording\n", record_path);
+            ret = 1;
+            goto quit;
+        }
+        /* rtcli records the CLI's own calls, the synchronous ones
+         * made while listening for events are recorded by the proxy */
+        scgi_set_trace(recorder);
+    }
+
     switch (action) {
         case LIST:
             list_torrents();
             break;
+        case REPLAY:
+            if (replay_serve(server, port, replay_path, max_speed) < 0)
+                ret = 1;
+            break;
+        case DAEMON:
+            if (connection_type != SCGI_CONNECTION) {
+                fprintf(stderr, "ERROR: The cache daemon only speaks SCGI\n");
+                ret = 1;
+                break;
+            }
+            if (cache_daemon_serve(server, port, fresh_ms) < 0)
+                ret = 1;
+            break;
+        case RECHECK:
+            recheck_torrents();
+            break;
+        case FILES:
+            list_files();
+            break;
+        case ADD:
+            if (optind >= argc) {
+                usage();
+                break;
+            }
+            if (connection_type != SCGI_CONNECTION) {
+                fprintf(stderr, "ERROR: Torrents can only be added over SCGI\n");
+                ret = 1;
+                break;
+            }
+            if (placement_add(server, port, place_auto, recorder, argv+optind, argc-optind) < 0)
+                ret = 1;
+            break;
+        case LISTEN:
+            if (connection_type != SCGI_CONNECTION) {
+                fprintf(stderr, "ERROR: Events can only be received over SCGI\n");
+                ret = 1;
+                break;
+            }
+            if (events_listen(server, port) < 0)
+                ret = 1;
+            break;
         default:
             assert_not_reached();
     }
 
 quit:
+    if (client)
+        rtcli_client_free(client);
+    scgi_set_trace(NULL);
+    trace_close(recorder);
     xfree(server);
     xmlrpc_env_clean(&env);
 
-    return 0;
+    return ret;
 }
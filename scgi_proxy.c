@@ -23,13 +23,21 @@
 #include <string.h>
 #include <signal.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 #include "util.h"
 #include "scgi_proxy.h"
 
+#define SCGI_HEADER_MAX (1 << 16)
+/* Far above anything rtorrent accepts, a larger request is not ours. */
+#define SCGI_CONTENT_MAX (64L << 20)
+
+static trace *recorder;
+
 static int transport_write(int sockfd, char *buf, int len) {
     int n;
 
@@ -59,12 +67,16 @@ static int transport_read(int sockfd, char **buff) {
         if (n == 0)
             break;
 
+        if (recorder)
+            trace_record(recorder, TRACE_RESPONSE, tmp, n);
+
         sum += n;
         *buff = xrealloc(*buff, sum+1);
-        strncpy(*buff+sum-n, tmp, n);
+        memcpy(*buff+sum-n, tmp, n);
     }
 
-    (*buff)[sum] = '\0';
+    if (*buff)
+        (*buff)[sum] = '\0';
 
     return sum;
 }
@@ -132,11 +144,43 @@ int scgi_create_transport(int *sockfd, const char *host, const char *port) {
     return ret;
 }
 
-/* FIXME UNIX socket support
-int create_transportu(int *sockfd, const char *file) {
-    return -2;
+static int unix_address(struct sockaddr_un *addr, const char *file) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(file) >= sizeof(addr->sun_path))
+        return -1;
+
+    strcpy(addr->sun_path, file);
+    return 0;
+}
+
+/* The connect itself never waits: a local listener whose backlog is full
+ * fails it with EAGAIN, so callers can move on to another transport. The
+ * socket is handed back in blocking mode. */
+int scgi_create_transportu(int *sockfd, const char *file) {
+    struct sockaddr_un addr;
+    int flags;
+
+    assert(sockfd);
+    assert(file);
+
+    if (unix_address(&addr, file) < 0)
+        return -2;
+
+    if ((*sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1)
+        return -2;
+
+    if (connect(*sockfd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+        (flags = fcntl(*sockfd, F_GETFL)) < 0 ||
+        fcntl(*sockfd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+        close(*sockfd);
+        *sockfd = -1;
+        return -2;
+    }
+
+    return 0;
 }
-*/
 
 /* FIXME the header and error checking is also important */
 int scgi_make_call(int *sockfd, char *msg, int msg_length, char **body) {
@@ -149,6 +193,12 @@ int scgi_make_call(int *sockfd, char *msg, int msg_length, char **body) {
 
     prepare_header(&header, &header_length, msg_length);
 
+    if (recorder) {
+        trace_begin(recorder);
+        trace_record(recorder, TRACE_REQUEST, header, header_length);
+        trace_record(recorder, TRACE_REQUEST, msg, msg_length);
+    }
+
     if ((ret = transport_write(*sockfd, header, header_length)) < 0)
         goto finish;
     if ((ret = transport_write(*sockfd, msg, msg_length)) < 0)
@@ -160,7 +210,181 @@ int scgi_make_call(int *sockfd, char *msg, int msg_length, char **body) {
     *body = xstrdup(find_body(buff));
     
 finish:
+    if (recorder)
+        trace_end(recorder);
     xfree((char*) header);
     xfree(buff);
     return ret;
 }
+
+/* Builds the complete request frame, netstring header and body, for
+ * callers that do their own I/O. */
+char *scgi_frame(const char *msg, size_t msg_length, size_t *frame_length) {
+    int header_length;
+    char *header, *frame;
+
+    assert(msg);
+    assert(frame_length);
+
+    prepare_header(&header, &header_length, (int) msg_length);
+
+    frame = xmalloc(header_length + msg_length);
+    memcpy(frame, header, header_length);
+    memcpy(frame + header_length, msg, msg_length);
+    *frame_length = header_length + msg_length;
+
+    xfree(header);
+    return frame;
+}
+
+void scgi_set_trace(trace *t) {
+    recorder = t;
+}
+
+int scgi_create_listener(int *sockfd, const char *host, const char *port) {
+    struct addrinfo hints;
+    struct addrinfo *result, *rp;
+    int ret, one = 1;
+
+    assert(sockfd);
+    assert(port);
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    hints.ai_protocol = 0;
+
+    ret = getaddrinfo(host, port, &hints, &result);
+    if (ret != 0)
+        return ret;
+
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        *sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (*sockfd == -1)
+            continue;
+
+        setsockopt(*sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(*sockfd, rp->ai_addr, rp->ai_addrlen) != -1 && listen(*sockfd, 16) != -1)
+            break;
+
+        close(*sockfd);
+    }
+
+    if (rp == NULL)
+        ret = -2;
+    freeaddrinfo(result);
+    return ret;
+}
+
+/* Works out how long the whole request frame is from the netstring
+ * header, or returns 0 if more bytes are needed and -1 if the frame is
+ * malformed. The SCGI spec requires CONTENT_LENGTH to be the first
+ * header. */
+static long request_length(const char *buf, size_t have) {
+    const char *colon, *header;
+    char *end;
+    long header_length, content_length;
+
+    if (!(colon = memchr(buf, ':', have)))
+        return have > 10 ? -1 : 0;
+
+    header_length = strtol(buf, &end, 10);
+    if (end != colon || header_length <= 0 || header_length > SCGI_HEADER_MAX)
+        return -1;
+
+    header = colon+1;
+    if ((size_t) (header - buf + header_length + 1) > have)
+        return 0;
+
+    if (header[header_length] != ',' || header[header_length-1] != '\0' ||
+        strcmp(header, "CONTENT_LENGTH") != 0)
+        return -1;
+
+    content_length = strtol(header+sizeof("CONTENT_LENGTH"), &end, 10);
+    if (*end != '\0' || content_length < 0 || content_length > SCGI_CONTENT_MAX)
+        return -1;
+
+    return header - buf + header_length + 1 + content_length;
+}
+
+int scgi_create_listeneru(int *sockfd, const char *file) {
+    struct sockaddr_un addr;
+
+    assert(sockfd);
+    assert(file);
+
+    if (unix_address(&addr, file) < 0)
+        return -2;
+
+    if ((*sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+        return -2;
+
+    if (bind(*sockfd, (struct sockaddr*) &addr, sizeof(addr)) == -1 || listen(*sockfd, 64) == -1) {
+        close(*sockfd);
+        return -2;
+    }
+
+    return 0;
+}
+
+int scgi_read_request(int sockfd, char **frame, size_t *frame_length) {
+    char *buf = NULL;
+    size_t have = 0, allocated = 0;
+    long need = 0;
+
+    assert(frame);
+    assert(frame_length);
+
+    while (need == 0 || have < (size_t) need) {
+        ssize_t n;
+
+        if (have == allocated) {
+            allocated = need > 0 ? (size_t) need : allocated + 1024;
+            buf = xrealloc(buf, allocated+1);
+        }
+
+        n = read(sockfd, buf+have, allocated-have);
+        if (n <= 0)
+            goto fail;
+        have += n;
+        buf[have] = '\0';
+
+        if (need == 0 && (need = request_length(buf, have)) < 0)
+            goto fail;
+    }
+
+    *frame = buf;
+    *frame_length = need;
+    return 0;
+
+fail:
+    xfree(buf);
+    return -1;
+}
+
+int scgi_send(int sockfd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(sockfd, buf, len);
+
+        if (n < 0)
+            return -1;
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Sends an already framed request and returns the raw response, SCGI
+ * status headers included. */
+int scgi_forward(int sockfd, const char *frame, size_t frame_length, char **response) {
+    assert(frame);
+    assert(response);
+
+    if (scgi_send(sockfd, frame, frame_length) < 0)
+        return -1;
+
+    return transport_read(sockfd, response);
+}
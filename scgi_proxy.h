@@ -20,12 +20,24 @@
 #ifndef scgi_proxy
 #define scgi_proxy
 
-int scgi_create_transport(int *sockfd, const char *host, const char *port);
+#include <stddef.h>
+
+#include "trace.h"
 
-/* This function should work over a UNIX socket 
+int scgi_create_transport(int *sockfd, const char *host, const char *port);
 int scgi_create_transportu(int *sockfd, const char *file);
-*/
 
 int scgi_make_call(int *sockfd, char *msg, int msg_length, char **body);
+char *scgi_frame(const char *msg, size_t msg_length, size_t *frame_length);
+
+/* Every exchange made through scgi_make_call() is recorded to t, pass
+ * NULL to stop recording. */
+void scgi_set_trace(trace *t);
+
+int scgi_create_listener(int *sockfd, const char *host, const char *port);
+int scgi_create_listeneru(int *sockfd, const char *file);
+int scgi_read_request(int sockfd, char **frame, size_t *frame_length);
+int scgi_send(int sockfd, const char *buf, size_t len);
+int scgi_forward(int sockfd, const char *frame, size_t frame_length, char **response);
 
 #endif
@@ -0,0 +1,106 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdbool.h>
+#include <string.h>
+
+/* the tree is only observable through what it prints, so the test looks
+ * at the nodes directly */
+#include "../filetree.c"
+#include "check.h"
+
+static void add(filetree *tree, const char *path, int64_t size, int priority) {
+    filetree_add(tree, path, strlen(path), size, size / 2, priority);
+}
+
+static dir_node *child(dir_node *node, const char *name) {
+    for (size_t i = 0; i < node->nchildren; ++i)
+        if (strcmp(node->children[i]->name, name) == 0)
+            return node->children[i];
+    return NULL;
+}
+
+static bool sorted(const dir_node *node) {
+    for (size_t i = 1; i < node->nchildren; ++i)
+        if (strcmp(node->children[i-1]->name, node->children[i]->name) >= 0)
+            return false;
+
+    for (size_t i = 0; i < node->nchildren; ++i)
+        if (!sorted(node->children[i]))
+            return false;
+
+    return true;
+}
+
+static void test_totals() {
+    filetree *tree = filetree_new("Torrent");
+    dir_node *a, *ab;
+
+    add(tree, "a/b/1", 100, 1);
+    add(tree, "a/2", 10, 2);
+    add(tree, "a//b/3", 1, 1);
+    add(tree, "top", 5, 0);
+
+    CHECK(tree->root->size == 116 && tree->root->done == 57);
+    CHECK(tree->root->files == 4 && tree->root->direct_files == 1);
+    CHECK(tree->root->nchildren == 1);
+
+    CHECK((a = child(tree->root, "a")) != NULL);
+    if (a) {
+        CHECK(a->size == 111 && a->files == 3 && a->direct_files == 1);
+        CHECK(a->nchildren == 1);
+        CHECK(strcmp(priority_to_string(a), "Mixed") == 0);
+
+        CHECK((ab = child(a, "b")) != NULL);
+        if (ab) {
+            CHECK(ab->files == 2 && ab->direct_files == 2);
+            CHECK(strcmp(priority_to_string(ab), "Normal") == 0);
+        }
+    }
+
+    filetree_free(tree);
+}
+
+static void test_order() {
+    filetree *tree = filetree_new("Torrent");
+    const char *names[] = { "m", "b", "z", "ab", "a", "b", "mm", "0", "a", "za" };
+    char path[16];
+
+    /* prefixes of each other, repeats and out of order arrivals */
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        snprintf(path, sizeof(path), "%s/f", names[i]);
+        add(tree, path, 1, 1);
+        snprintf(path, sizeof(path), "%s/%s/f", names[i], names[(i+3) % 10]);
+        add(tree, path, 1, 1);
+    }
+
+    CHECK(tree->root->nchildren == 8);
+    CHECK(sorted(tree->root));
+    CHECK(child(tree->root, "a") && child(tree->root, "a")->files == 4);
+    CHECK(child(tree->root, "za") && child(tree->root, "za")->files == 2);
+
+    filetree_free(tree);
+}
+
+int main() {
+    test_totals();
+    test_order();
+
+    return check_failures ? 1 : 0;
+}
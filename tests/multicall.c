@@ -0,0 +1,100 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <string.h>
+
+#include "multicall.h"
+#include "check.h"
+
+#define RESPONSE(rows) \
+    "<?xml version=\"1.0\"?><methodResponse><params><param><value><array><data>" \
+    rows "</data></array></value></param></params></methodResponse>"
+
+static bool split(const char *xml, multicall_split *out) {
+    return multicall_split_rows(xml, strlen(xml), out);
+}
+
+static bool row_is(const multicall_row *row, const char *expected) {
+    return (size_t) (row->end - row->begin) == strlen(expected) &&
+           memcmp(row->begin, expected, row->end - row->begin) == 0;
+}
+
+static void test_rows() {
+    multicall_split s;
+
+    CHECK(split(RESPONSE("<value><array><data><value><string>a</string></value>"
+                         "<value><i8>1</i8></value></data></array></value>"
+                         "<value><array><data><value>b&lt;c</value></data></array></value>"), &s));
+    CHECK(s.size == 2);
+    if (s.size == 2) {
+        CHECK(row_is(&s.rows[0], "<value><array><data><value><string>a</string></value>"
+                                 "<value><i8>1</i8></value></data></array></value>"));
+        CHECK(row_is(&s.rows[1], "<value><array><data><value>b&lt;c</value></data></array></value>"));
+    }
+    multicall_split_free(&s);
+}
+
+static void test_empty() {
+    multicall_split s;
+
+    CHECK(split(RESPONSE(""), &s));
+    CHECK(s.size == 0);
+    multicall_split_free(&s);
+
+    CHECK(split(RESPONSE("<value/><value><array><data/></array></value>"), &s));
+    CHECK(s.size == 2);
+    if (s.size == 2)
+        CHECK(row_is(&s.rows[0], "<value/>"));
+    multicall_split_free(&s);
+}
+
+static void test_nested() {
+    multicall_split s;
+
+    /* values inside a row never start rows of their own */
+    CHECK(split(RESPONSE("<value><array><data><value><array><data><value>x</value>"
+                         "</data></array></value></data></array></value>"), &s));
+    CHECK(s.size == 1);
+    multicall_split_free(&s);
+}
+
+static void test_rejected() {
+    multicall_split s;
+
+    CHECK(!split("<?xml version=\"1.0\"?><methodResponse><fault><value><struct>"
+                 "<member><name>faultCode</name><value><int>-501</int></value></member>"
+                 "</struct></value></fault></methodResponse>", &s));
+    CHECK(s.rows == NULL && s.size == 0);
+
+    CHECK(!split("<methodResponse><params><param><value><string>x</string></value>"
+                 "</param></params></methodResponse>", &s));
+    CHECK(!split(RESPONSE("<value><array><data>"), &s));
+    CHECK(!split("<methodResponse><params><param><value><array><data>", &s));
+    CHECK(!split("<methodResponse><params><param><value><array", &s));
+    CHECK(!split("", &s));
+}
+
+int main() {
+    test_rows();
+    test_empty();
+    test_nested();
+    test_rejected();
+
+    return check_failures ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <string.h>
+
+/* scoring only has file local entry points */
+#include "../placement.c"
+#include "check.h"
+
+#define GIB ((int64_t) 1 << 30)
+
+static int64_t payload(const char *torrent) {
+    return payload_size(torrent, strlen(torrent));
+}
+
+static void test_payload() {
+    CHECK(payload("d4:infod6:lengthi1000e4:name1:a12:piece lengthi16384eee") == 1000);
+    CHECK(payload("d4:infod5:filesld6:lengthi10e4:pathl1:xeed6:lengthi20e4:pathl1:yeee"
+                  "4:name1:bee") == 30);
+    /* only integers count, a string under "length" is skipped */
+    CHECK(payload("d6:length3:abc4:infod6:lengthi7eee") == 7);
+
+    CHECK(payload("") < 0);
+    CHECK(payload("i5e") < 0);
+    CHECK(payload("d4:infod6:lengthi-1eee") < 0);
+    CHECK(payload("d4:infod6:lengthi5e") < 0);
+    CHECK(payload("d99:abc") < 0);
+}
+
+static void test_call_size() {
+    torrent_file small = { 0 }, large = { 0 };
+
+    small.len = 3;
+    large.len = 57 * 100;
+
+    CHECK(call_size(&small) == 4 + PLACEMENT_CALL_OVERHEAD);
+    CHECK(call_size(&large) == 7600 + 200 + PLACEMENT_CALL_OVERHEAD);
+}
+
+static void free_nodes(node_list *list) {
+    for (size_t i = 0; i < list->size; ++i) {
+        xfree(list->nodes[i].error);
+        xfree(list->nodes[i].endpoint);
+        xfree(list->nodes[i].port);
+        xfree(list->nodes[i].server);
+    }
+    xfree(list->nodes);
+}
+
+static void test_assign() {
+    node_list list = { NULL, 0 };
+    torrent_file files[6];
+
+    add_node(&list, "busy", "5000");
+    add_node(&list, "idle", "5000");
+    add_node(&list, "unknown", "5000");
+    add_node(&list, "down", "5000");
+    add_node(&list, "busy", "5000");
+    CHECK(list.size == 4);
+
+    list.nodes[0].torrents = 100;
+    list.nodes[0].up_rate = 10 << 20;
+    list.nodes[0].free_bytes = 1000 * GIB;
+    list.nodes[1].torrents = 10;
+    list.nodes[1].free_bytes = 5 * GIB;
+    list.nodes[3].error = xstrdup("down");
+
+    /* space is unknown until an instance holds a torrent */
+    CHECK(!has_room(&list.nodes[2], 0));
+    CHECK(has_room(&list.nodes[1], 5 * GIB));
+    CHECK(!has_room(&list.nodes[1], 5 * GIB + 1));
+
+    memset(files, 0, sizeof(files));
+    for (int i = 0; i < 6; ++i)
+        files[i].payload = (i + 1) * GIB;
+
+    assign_files(&list, files, 6);
+
+    /* largest first: the idle instance takes what it has room for, the
+     * busy one the rest, the unknown and failed ones nothing */
+    CHECK(files[5].node == 0);
+    CHECK(files[4].node == 1);
+    CHECK(files[3].node == 0);
+    CHECK(files[2].node == 0);
+    CHECK(files[1].node == 0);
+    CHECK(files[0].node == 0);
+    for (int i = 0; i < 6; ++i)
+        CHECK(!files[i].error);
+    CHECK(list.nodes[1].added == 1 && list.nodes[1].added_bytes == 5 * GIB);
+    CHECK(list.nodes[2].added == 0 && list.nodes[3].added == 0);
+
+    free_nodes(&list);
+}
+
+static void test_no_room() {
+    node_list list = { NULL, 0 };
+    torrent_file files[2];
+
+    add_node(&list, "full", "5000");
+    add_node(&list, "unknown", "5000");
+    list.nodes[0].torrents = 1;
+    list.nodes[0].free_bytes = GIB;
+
+    memset(files, 0, sizeof(files));
+    files[0].payload = 2 * GIB;
+    files[1].payload = GIB;
+
+    /* without room anywhere the instance of unknown space is tried */
+    assign_files(&list, files, 2);
+    CHECK(files[0].node == 1 && !files[0].error);
+    CHECK(files[1].node == 0 && !files[1].error);
+
+    list.nodes[1].error = xstrdup("down");
+    memset(files, 0, sizeof(files));
+    files[0].payload = 2 * GIB;
+
+    assign_files(&list, files, 1);
+    CHECK(files[0].error && strcmp(files[0].error, "No instance has room for it") == 0);
+    xfree(files[0].error);
+
+    free_nodes(&list);
+}
+
+int main() {
+    test_payload();
+    test_call_size();
+    test_assign();
+    test_no_room();
+
+    return check_failures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "check.h"
+
+static char path[] = "/tmp/rtorrent-cli-trace-XXXXXX";
+
+static void write_raw(const char *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static void test_round_trip() {
+    char header[] = "Status: 200 OK\r\n\r\n", empty[] = "", body[] = "<methodResponse/>";
+    uint64_t start;
+    trace_chunk chunks[3] = {
+        { 0, header, 18 },
+        { 0, empty, 0 },
+        { 0, body, 17 }
+    };
+    trace_log log;
+    trace *t;
+
+    CHECK((t = trace_open(path)) != NULL);
+    if (!t)
+        return;
+
+    /* chunk times are stored relative to the start of their exchange */
+    start = trace_now();
+    chunks[0].at = start + 1000;
+    chunks[1].at = start + 2000;
+    chunks[2].at = start + 300000;
+
+    trace_write_exchange(t, start, "request", 7, chunks, 3, start + 400000);
+    trace_begin(t);
+    trace_record(t, TRACE_REQUEST, "head", 4);
+    trace_record(t, TRACE_REQUEST, "body", 4);
+    trace_record(t, TRACE_RESPONSE, "reply", 5);
+    trace_end(t);
+    trace_close(t);
+
+    CHECK(trace_load(path, &log) == 0);
+    CHECK(log.size == 2);
+    if (log.size != 2)
+        return;
+
+    CHECK(log.exchanges[0].request_len == 7);
+    CHECK(memcmp(log.exchanges[0].request, "request", 7) == 0);
+    CHECK(log.exchanges[0].nchunks == 3);
+    CHECK(log.exchanges[0].chunks[0].len == 18);
+    CHECK(log.exchanges[0].chunks[1].len == 0);
+    CHECK(log.exchanges[0].chunks[2].at == 300000);
+    CHECK(memcmp(log.exchanges[0].chunks[2].data, "<methodResponse/>", 17) == 0);
+
+    /* request records of one exchange are joined into a single frame */
+    CHECK(log.exchanges[1].request_len == 8);
+    CHECK(memcmp(log.exchanges[1].request, "headbody", 8) == 0);
+    CHECK(log.exchanges[1].nchunks == 1);
+    CHECK(log.exchanges[1].start >= log.exchanges[0].start);
+
+    trace_log_free(&log);
+}
+
+#define HEADER TRACE_MAGIC "\001"
+#define WRITE_RAW(data) write_raw(data, sizeof(data) - 1)
+
+static void test_malformed() {
+    trace_log log;
+
+    /* an exchange cut short by the end of the file is dropped */
+    WRITE_RAW(HEADER "B\000Q\001\003abcE\002B\003R\001\000");
+    CHECK(trace_load(path, &log) == 0);
+    CHECK(log.size == 1);
+    trace_log_free(&log);
+
+    WRITE_RAW(HEADER "B\000Q\001\003abcB\005E\006");
+    CHECK(trace_load(path, &log) < 0);
+
+    WRITE_RAW(HEADER "B\000Q\001\050abc");
+    CHECK(trace_load(path, &log) < 0);
+
+    WRITE_RAW(HEADER "Q\001\003abc");
+    CHECK(trace_load(path, &log) < 0);
+
+    WRITE_RAW(HEADER "B\377\377\377\377\377\377\377\377\377\377\377");
+    CHECK(trace_load(path, &log) < 0);
+
+    WRITE_RAW(TRACE_MAGIC "\002");
+    CHECK(trace_load(path, &log) < 0);
+
+    WRITE_RAW("RTC");
+    CHECK(trace_load(path, &log) < 0);
+}
+
+int main() {
+    int fd;
+
+    if ((fd = mkstemp(path)) < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    test_round_trip();
+    test_malformed();
+
+    unlink(path);
+    return check_failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utf8.h"
+#include "check.h"
+
+#define ELLIPSIS "\xe2\x80\xa6"
+
+static utf8_span fit(const char *s, size_t max_cols) {
+    utf8_span span;
+
+    utf8_fit(s, strlen(s), max_cols, &span);
+    return span;
+}
+
+/* Returns what utf8_print() writes, to be freed by the caller. */
+static char *print(const char *s, size_t max_cols, size_t width) {
+    utf8_span span = fit(s, max_cols);
+    char *out = NULL;
+    size_t len;
+    FILE *f = open_memstream(&out, &len);
+
+    utf8_print(f, s, &span, width);
+    fclose(f);
+    return out;
+}
+
+static bool printed(const char *s, size_t max_cols, size_t width, const char *expected) {
+    char *out = print(s, max_cols, width);
+    bool same = strcmp(out, expected) == 0;
+
+    free(out);
+    return same;
+}
+
+static void test_ascii() {
+    utf8_span span;
+
+    span = fit("ubuntu-24.04-desktop-amd64.iso", 100);
+    CHECK(span.bytes == 30 && span.cols == 30 && !span.truncated && span.valid);
+
+    /* exactly as wide as the limit still fits whole */
+    span = fit("0123456789abcdef", 16);
+    CHECK(span.bytes == 16 && !span.truncated);
+
+    span = fit("0123456789abcdefg", 16);
+    CHECK(span.bytes == 15 && span.cols == 15 && span.truncated);
+
+    span = fit("", 1);
+    CHECK(span.bytes == 0 && span.cols == 0 && !span.truncated);
+}
+
+static void test_width() {
+    utf8_span span;
+
+    /* wide characters take two columns, combining marks none */
+    span = fit("\xe6\x97\xa5\xe6\x9c\xac", 10);
+    CHECK(span.bytes == 6 && span.cols == 4);
+
+    span = fit("e\xcc\x81t\xc3\xa9", 10);
+    CHECK(span.bytes == 6 && span.cols == 3);
+
+    span = fit("\xf0\x9f\x8e\xac movie", 10);
+    CHECK(span.cols == 8);
+
+    /* a wide character that would leave no room for the ellipsis goes */
+    span = fit("ab\xe6\x97\xa5\xe6\x9c\xac", 5);
+    CHECK(span.truncated && span.bytes == 5 && span.cols == 4);
+
+    span = fit("abc\xe6\x97\xa5\xe6\x9c\xac", 5);
+    CHECK(span.truncated && span.bytes == 3 && span.cols == 3);
+}
+
+static void test_invalid() {
+    CHECK(!fit("bad\x1b[31m", 20).valid);
+    CHECK(!fit("tab\there", 20).valid);
+    CHECK(!fit("\xc0\xaf", 20).valid);
+    CHECK(!fit("\xed\xa0\x80", 20).valid);
+    CHECK(!fit("\xf4\x90\x80\x80", 20).valid);
+    CHECK(!fit("cut \xe6\x97", 20).valid);
+    CHECK(fit("0123456789\x7f", 20).cols == 11);
+}
+
+static void test_print() {
+    CHECK(printed("plain", 10, 0, "plain"));
+    CHECK(printed("plain", 10, 8, "plain   "));
+    CHECK(printed("0123456789", 5, 0, "0123" ELLIPSIS));
+    CHECK(printed("0123456789", 5, 7, "0123" ELLIPSIS "  "));
+    CHECK(printed("a\x1b[1mb", 10, 0, "a?[1mb"));
+    CHECK(printed("\xc0\xaf\xe6\x97\xa5", 10, 0, "??\xe6\x97\xa5"));
+}
+
+int main() {
+    test_ascii();
+    test_width();
+    test_invalid();
+    test_print();
+
+    return check_failures ? 1 : 0;
+}
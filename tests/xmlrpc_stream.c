@@ -0,0 +1,129 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdlib.h>
+#include <string.h>
+#include <xmlrpc-c/base.h>
+
+#include "util.h"
+#include "xmlrpc_stream.h"
+#include "check.h"
+
+#define RESPONSE(rows) \
+    "<?xml version=\"1.0\"?><methodResponse><params><param><value><array><data>" \
+    rows "</data></array></value></param></params></methodResponse>"
+
+#define ROWS \
+    "<value><array><data>" \
+        "<value><string>a &amp; b</string></value>" \
+        "<value><i8>8589934592</i8></value>" \
+        "<value><i4>-7</i4></value>" \
+        "<value>&#x65E5;&#26412; &lt;&unknown;&gt;</value>" \
+        "<value><string/></value>" \
+    "</data></array></value>" \
+    "<value><array><data>" \
+        "<value><array><data><value>nested, dropped</value></data></array></value>" \
+        "<value><int>3</int></value>" \
+    "</data></array></value>"
+
+typedef struct {
+    size_t rows;
+    size_t fields;
+    char text[256];
+    int64_t sum;
+} collected;
+
+static void collect(const xmlrpc_stream_field *fields, size_t count, void *data) {
+    collected *c = data;
+
+    c->rows++;
+    c->fields += count;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (fields[i].type == XMLRPC_TYPE_STRING) {
+            CHECK(fields[i].string[fields[i].length] == '\0');
+            strncat(c->text, fields[i].string, sizeof(c->text) - strlen(c->text) - 1);
+            strncat(c->text, "|", sizeof(c->text) - strlen(c->text) - 1);
+        } else
+            c->sum += fields[i].i;
+    }
+}
+
+/* Feeds xml in pieces of step bytes and returns the fault code, 0 if
+ * there was none. */
+static int decode(const char *xml, size_t step, collected *c) {
+    xmlrpc_env env;
+    xmlrpc_stream *stream;
+    size_t len = strlen(xml);
+    int fault;
+
+    memset(c, 0, sizeof(collected));
+    xmlrpc_env_init(&env);
+
+    stream = xmlrpc_stream_new(collect, c);
+    for (size_t i = 0; i < len; i += step)
+        xmlrpc_stream_feed(stream, xml + i, len - i < step ? len - i : step);
+    xmlrpc_stream_finish(&env, stream);
+    xmlrpc_stream_free(stream);
+
+    fault = env.fault_occurred ? env.fault_code : 0;
+    xmlrpc_env_clean(&env);
+    return fault;
+}
+
+static void test_rows() {
+    collected c;
+
+    /* split at every possible point, entities and tags included */
+    for (size_t step = 1; step <= 64; ++step) {
+        CHECK(decode(RESPONSE(ROWS), step, &c) == 0);
+        CHECK(c.rows == 2);
+        CHECK(c.fields == 6);
+        CHECK(strcmp(c.text, "a & b|\xe6\x97\xa5\xe6\x9c\xac <&unknown;>||") == 0);
+        CHECK(c.sum == 8589934592LL - 7 + 3);
+    }
+}
+
+static void test_fault() {
+    collected c;
+
+    CHECK(decode("<?xml version=\"1.0\"?><methodResponse><fault><value><struct>"
+                 "<member><name>faultCode</name><value><int>-501</int></value></member>"
+                 "<member><name>faultString</name><value><string>Bad</string></value></member>"
+                 "</struct></value></fault></methodResponse>", 7, &c) == -501);
+    CHECK(c.rows == 0);
+}
+
+static void test_truncated() {
+    collected c;
+    const char *xml = RESPONSE(ROWS);
+    char *cut = xstrdup(xml);
+
+    cut[strlen(xml) / 2] = '\0';
+    CHECK(decode(cut, 5, &c) == -32300);
+    xfree(cut);
+}
+
+int main() {
+    test_rows();
+    test_fault();
+    test_truncated();
+
+    return check_failures ? 1 : 0;
+}
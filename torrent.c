@@ -0,0 +1,231 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <assert.h>
+
+#include "util.h"
+#include "multicall.h"
+#include "xmlrpc_client.h"
+#include "torrent.h"
+
+static void torrent_info_free(torrent_info *info) {
+    xfree((char*) info->name);
+    xfree((char*) info->hash);
+    xfree(info);
+}
+
+torrent_array *torrent_array_new(size_t size) {
+    torrent_array *array = xmalloc(sizeof(torrent_array));
+
+    array->torrents = xmalloc(sizeof(torrent_info*)*size);
+
+    for (size_t i = 0; i < size; ++i) {
+        array->torrents[i] = xmalloc0(sizeof(torrent_info));
+    }
+    array->size = size;
+    return array;
+}
+
+void torrent_array_free(torrent_array *array) {
+    if (!array)
+        return;
+
+    for (size_t i = 0; i < array->size; ++i) {
+        torrent_info_free(array->torrents[i]);
+    }
+    xfree(array->torrents);
+    xfree(array);
+}
+
+const char *torrent_list_method(bool multicall2) {
+    return multicall2 ? "d.multicall2" : "d.multicall";
+}
+
+xmlrpc_value *torrent_list_params(xmlrpc_env *env, bool multicall2) {
+    xmlrpc_value *params, *tmp;
+    const char **p;
+    const char *arguments[] = { "main", "d.hash=", "d.name=", "d.is_active=",
+                                "d.state=", "d.bytes_done=", "d.size_bytes=",
+                                "d.up.rate=", "d.down.rate=", "d.down.total=",
+                                "d.ratio=", "d.complete=", NULL };
+
+    XMLRPC_ASSERT_ENV_OK(env);
+
+    params = xmlrpc_array_new(env);
+    if (env->fault_occurred)
+        return NULL;
+
+    /* d.multicall2 wants an (empty) target before the view name */
+    if (multicall2) {
+        xmlrpc_array_append_item(env, params, tmp = xmlrpc_string_new(env, ""));
+        xmlrpc_DECREF(tmp);
+    }
+
+    for (p = arguments; *p && !env->fault_occurred; ++p) {
+        xmlrpc_array_append_item(env, params, tmp = xmlrpc_string_new(env, *p));
+        xmlrpc_DECREF(tmp);
+    }
+
+    if (env->fault_occurred) {
+        xmlrpc_DECREF(params);
+        return NULL;
+    }
+
+    return params;
+}
+
+static void get_bool_from_int64(xmlrpc_env *env, xmlrpc_value *value, bool *result) {
+    int64_t tmp = 0;
+    xmlrpc_get_int64(env, value, &tmp);
+    *result = tmp == 1 ? true : false;
+}
+
+static void decode_torrent(xmlrpc_env *env, xmlrpc_value *tarray, torrent_info *info) {
+    size_t tarray_size;
+
+    if (xmlrpc_value_type(tarray) != XMLRPC_TYPE_ARRAY) {
+        xmlrpc_env_set_fault(env, -32300, "Torrent list row is not an array");
+        return;
+    }
+
+    XMLRPC_ASSERT_ARRAY_OK(tarray);
+    tarray_size = xmlrpc_array_size(env, tarray);
+
+    for (size_t j = 0; j < tarray_size && !env->fault_occurred; ++j) {
+        xmlrpc_value *item = NULL;
+
+        xmlrpc_array_read_item(env, tarray, j, &item);
+        if (env->fault_occurred)
+            break;
+
+        switch (j) {
+            case 0:
+                xmlrpc_get_string(env, item, &info->hash);
+                break;
+            case 1:
+                xmlrpc_get_string(env, item, &info->name);
+                break;
+            case 2:
+                get_bool_from_int64(env, item, &info->active);
+                break;
+            case 3:
+                get_bool_from_int64(env, item, &info->started);
+                break;
+            case 4:
+                xmlrpc_get_int64(env, item, &info->done_bytes);
+                break;
+            case 5:
+                xmlrpc_get_int64(env, item, &info->size_bytes);
+                break;
+            case 6:
+                xmlrpc_get_int64(env, item, &info->up_rate);
+                break;
+            case 7:
+                xmlrpc_get_int64(env, item, &info->down_rate);
+                break;
+            case 8:
+                xmlrpc_get_int64(env, item, &info->down_total);
+                break;
+            case 9:
+                xmlrpc_get_int64(env, item, &info->ratio);
+                break;
+            case 10:
+                get_bool_from_int64(env, item, &info->complete);
+                break;
+            default:
+                ;
+        }
+        xmlrpc_DECREF(item);
+    }
+}
+
+static void decode_torrent_row(xmlrpc_env *env, xmlrpc_value *row, size_t index, void *data) {
+    torrent_array *array = data;
+
+    array->torrents[index]->id = index+1;
+    decode_torrent(env, row, array->torrents[index]);
+}
+
+/* Decodes a parsed d.multicall reply. *result is left NULL for an empty
+ * session and on faults. */
+void torrent_decode_list(xmlrpc_env *env, xmlrpc_value *xml_array, torrent_array **result) {
+    size_t size;
+
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(result);
+
+    *result = NULL;
+
+    if (xmlrpc_value_type(xml_array) != XMLRPC_TYPE_ARRAY) {
+        xmlrpc_env_set_fault_formatted(env, -32300, "Torrent list is not an array");
+        return;
+    }
+
+    XMLRPC_ASSERT_ARRAY_OK(xml_array);
+    size = xmlrpc_array_size(env, xml_array);
+    if (env->fault_occurred || size <= 0)
+        return;
+
+    *result = torrent_array_new(size);
+    for (size_t i = 0; i < size && !env->fault_occurred; ++i) {
+        xmlrpc_value *tarray = NULL;
+
+        xmlrpc_array_read_item(env, xml_array, i, &tarray);
+        if (env->fault_occurred)
+            break;
+
+        decode_torrent_row(env, tarray, i, *result);
+        xmlrpc_DECREF(tarray);
+    }
+
+    if (env->fault_occurred) {
+        torrent_array_free(*result);
+        *result = NULL;
+    }
+}
+
+/* Splits the raw response at its top level rows and decodes them on
+ * `threads` threads straight into the result table. Returns false if the
+ * response could not be split, in which case nothing was decoded and the
+ * caller has to parse it the ordinary way. */
+bool torrent_decode_list_raw(xmlrpc_env *env, const char *xml, size_t len, unsigned int threads, torrent_array **result) {
+    multicall_split split;
+
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(xml);
+    assert(result);
+
+    *result = NULL;
+
+    if (!multicall_split_rows(xml, len, &split))
+        return false;
+
+    if (split.size > 0) {
+        *result = torrent_array_new(split.size);
+        multicall_decode(env, &split, threads, decode_torrent_row, *result);
+
+        if (env->fault_occurred) {
+            torrent_array_free(*result);
+            *result = NULL;
+        }
+    }
+
+    multicall_split_free(&split);
+    return true;
+}
@@ -0,0 +1,63 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef torrenth
+#define torrenth
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <xmlrpc-c/base.h>
+
+/* librtorrentcli is built with hidden visibility, only what is marked
+ * with this is exported from the shared library. */
+#ifndef RTCLI_EXPORT
+#define RTCLI_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct {
+    int64_t id;
+    const char *hash;
+    const char *name;
+    bool complete;
+    bool active;
+    bool started;
+    int64_t size_bytes;
+    int64_t done_bytes;
+    int64_t ratio;
+    int64_t down_total;
+    int64_t up_rate;
+    int64_t down_rate;
+} torrent_info;
+
+typedef struct {
+    torrent_info **torrents;
+    size_t size;
+} torrent_array;
+
+RTCLI_EXPORT torrent_array *torrent_array_new(size_t size);
+RTCLI_EXPORT void torrent_array_free(torrent_array *array);
+
+RTCLI_EXPORT const char *torrent_list_method(bool multicall2);
+RTCLI_EXPORT xmlrpc_value *torrent_list_params(xmlrpc_env *env, bool multicall2);
+
+RTCLI_EXPORT void torrent_decode_list(xmlrpc_env *env, xmlrpc_value *xml_array, torrent_array **result);
+RTCLI_EXPORT bool torrent_decode_list_raw(xmlrpc_env *env, const char *xml, size_t len, unsigned int threads, torrent_array **result);
+
+#endif
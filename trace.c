@@ -0,0 +1,252 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "util.h"
+#include "trace.h"
+
+struct trace {
+    FILE *file;
+    uint64_t origin;
+    uint64_t exchange;
+};
+
+uint64_t trace_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put_varint(FILE *f, uint64_t v) {
+    while (v >= 0x80) {
+        fputc((int) (v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int) v, f);
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v) {
+    *v = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p == end)
+            return -1;
+
+        *v |= (uint64_t) (**p & 0x7f) << shift;
+        if (!(*(*p)++ & 0x80))
+            return 0;
+    }
+
+    return -1;
+}
+
+trace *trace_open(const char *path) {
+    trace *t;
+    FILE *f;
+
+    assert(path);
+
+    if (!(f = fopen(path, "wb")))
+        return NULL;
+
+    fputs(TRACE_MAGIC, f);
+    fputc(TRACE_VERSION, f);
+
+    t = xmalloc0(sizeof(trace));
+    t->file = f;
+    t->origin = trace_now();
+    return t;
+}
+
+void trace_close(trace *t) {
+    if (!t)
+        return;
+
+    fclose(t->file);
+    xfree(t);
+}
+
+void trace_begin(trace *t) {
+    assert(t);
+
+    t->exchange = trace_now();
+    fputc(TRACE_BEGIN, t->file);
+    put_varint(t->file, t->exchange - t->origin);
+}
+
+void trace_record(trace *t, int kind, const char *buf, size_t len) {
+    assert(t);
+    assert(kind == TRACE_REQUEST || kind == TRACE_RESPONSE);
+
+    fputc(kind, t->file);
+    put_varint(t->file, trace_now() - t->exchange);
+    put_varint(t->file, len);
+    fwrite(buf, 1, len, t->file);
+}
+
+void trace_end(trace *t) {
+    assert(t);
+
+    fputc(TRACE_END, t->file);
+    put_varint(t->file, trace_now() - t->exchange);
+    fflush(t->file);
+}
+
+/* Writes a whole exchange in one go, for callers that run several at the
+ * same time and so cannot record them as they happen. start, end and the
+ * chunk times are trace_now() values. */
+void trace_write_exchange(trace *t, uint64_t start, const char *request, size_t request_len,
+                          const trace_chunk *chunks, size_t nchunks, uint64_t end) {
+    assert(t);
+    assert(request);
+
+    fputc(TRACE_BEGIN, t->file);
+    put_varint(t->file, start - t->origin);
+
+    fputc(TRACE_REQUEST, t->file);
+    put_varint(t->file, 0);
+    put_varint(t->file, request_len);
+    fwrite(request, 1, request_len, t->file);
+
+    for (size_t i = 0; i < nchunks; ++i) {
+        fputc(TRACE_RESPONSE, t->file);
+        put_varint(t->file, chunks[i].at - start);
+        put_varint(t->file, chunks[i].len);
+        fwrite(chunks[i].data, 1, chunks[i].len, t->file);
+    }
+
+    fputc(TRACE_END, t->file);
+    put_varint(t->file, end - start);
+    fflush(t->file);
+}
+
+static void exchange_free(trace_exchange *exchange) {
+    for (size_t i = 0; i < exchange->nchunks; ++i)
+        xfree(exchange->chunks[i].data);
+    xfree(exchange->chunks);
+    xfree(exchange->request);
+}
+
+/* Loads a whole trace into memory. Request chunks of an exchange are
+ * joined into a single frame, response chunks are kept apart so that
+ * they can be replayed with their original timing. An exchange that was
+ * cut short by the end of the file is dropped. */
+int trace_load(const char *path, trace_log *log) {
+    const unsigned char *p, *end;
+    trace_exchange *cur = NULL;
+    size_t len, allocated = 0, chunks_allocated = 0;
+    char *buf;
+
+    assert(path);
+    assert(log);
+
+    log->exchanges = NULL;
+    log->size = 0;
+
+    if (!(buf = read_file(path, &len)))
+        return -1;
+
+    p = (const unsigned char*) buf;
+    end = p + len;
+
+    if (len < sizeof(TRACE_MAGIC) || memcmp(p, TRACE_MAGIC, sizeof(TRACE_MAGIC)-1) != 0 ||
+        p[sizeof(TRACE_MAGIC)-1] != TRACE_VERSION)
+        goto fail;
+    p += sizeof(TRACE_MAGIC);
+
+    while (p < end) {
+        int kind = *p++;
+        uint64_t at, n;
+
+        if (get_varint(&p, end, &at) < 0)
+            goto fail;
+
+        switch (kind) {
+            case TRACE_BEGIN:
+                /* writers always end an exchange before the next one */
+                if (cur)
+                    goto fail;
+                if (log->size == allocated) {
+                    allocated = allocated ? allocated * 2 : 16;
+                    log->exchanges = xrealloc(log->exchanges, sizeof(trace_exchange) * allocated);
+                }
+                cur = &log->exchanges[log->size];
+                memset(cur, 0, sizeof(trace_exchange));
+                cur->start = at;
+                chunks_allocated = 0;
+                break;
+            case TRACE_REQUEST:
+            case TRACE_RESPONSE:
+                if (!cur || get_varint(&p, end, &n) < 0 || n > (uint64_t) (end - p))
+                    goto fail;
+
+                if (kind == TRACE_REQUEST) {
+                    cur->request = xrealloc(cur->request, cur->request_len + n + 1);
+                    memcpy(cur->request + cur->request_len, p, n);
+                    cur->request_len += n;
+                } else {
+                    if (cur->nchunks == chunks_allocated) {
+                        chunks_allocated = chunks_allocated ? chunks_allocated * 2 : 16;
+                        cur->chunks = xrealloc(cur->chunks, sizeof(trace_chunk) * chunks_allocated);
+                    }
+                    cur->chunks[cur->nchunks].at = at;
+                    cur->chunks[cur->nchunks].data = xmalloc(n ? n : 1);
+                    memcpy(cur->chunks[cur->nchunks].data, p, n);
+                    cur->chunks[cur->nchunks].len = n;
+                    cur->nchunks++;
+                }
+                p += n;
+                break;
+            case TRACE_END:
+                if (!cur)
+                    goto fail;
+                log->size++;
+                cur = NULL;
+                break;
+            default:
+                goto fail;
+        }
+    }
+
+    if (cur)
+        exchange_free(cur);
+
+    xfree(buf);
+    return 0;
+
+fail:
+    if (cur)
+        exchange_free(cur);
+    trace_log_free(log);
+    xfree(buf);
+    return -1;
+}
+
+void trace_log_free(trace_log *log) {
+    for (size_t i = 0; i < log->size; ++i)
+        exchange_free(&log->exchanges[i]);
+    xfree(log->exchanges);
+    log->exchanges = NULL;
+    log->size = 0;
+}
@@ -0,0 +1,75 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef traceh
+#define traceh
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A trace file starts with TRACE_MAGIC followed by a version byte and a
+ * sequence of records. Every record is a kind byte, a varint timestamp in
+ * nanoseconds and, for data records, a varint length and the raw bytes.
+ * TRACE_BEGIN is stamped relative to the start of the trace, every other
+ * record relative to the TRACE_BEGIN of its exchange. */
+#define TRACE_MAGIC "RTCTRACE"
+#define TRACE_VERSION 1
+
+enum {
+    TRACE_BEGIN = 'B',
+    TRACE_REQUEST = 'Q',
+    TRACE_RESPONSE = 'R',
+    TRACE_END = 'E'
+};
+
+typedef struct trace trace;
+
+typedef struct {
+    uint64_t at;
+    char *data;
+    size_t len;
+} trace_chunk;
+
+typedef struct {
+    uint64_t start;
+    char *request;
+    size_t request_len;
+    trace_chunk *chunks;
+    size_t nchunks;
+} trace_exchange;
+
+typedef struct {
+    trace_exchange *exchanges;
+    size_t size;
+} trace_log;
+
+uint64_t trace_now();
+
+trace *trace_open(const char *path);
+void trace_close(trace *t);
+void trace_begin(trace *t);
+void trace_record(trace *t, int kind, const char *buf, size_t len);
+void trace_end(trace *t);
+void trace_write_exchange(trace *t, uint64_t start, const char *request, size_t request_len,
+                          const trace_chunk *chunks, size_t nchunks, uint64_t end);
+
+int trace_load(const char *path, trace_log *log);
+void trace_log_free(trace_log *log);
+
+#endif
@@ -0,0 +1,256 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "utf8.h"
+
+#define ONES UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
+
+#define ELLIPSIS "\xe2\x80\xa6"
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} range;
+
+/* Combining marks, zero width spaces and joiners, variation selectors. */
+static const range zero_width[] = {
+    { 0x0300, 0x036f }, { 0x0483, 0x0489 }, { 0x0591, 0x05bd }, { 0x05bf, 0x05bf },
+    { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 }, { 0x05c7, 0x05c7 }, { 0x0610, 0x061a },
+    { 0x064b, 0x065f }, { 0x0670, 0x0670 }, { 0x06d6, 0x06dc }, { 0x06df, 0x06e4 },
+    { 0x06e7, 0x06e8 }, { 0x06ea, 0x06ed }, { 0x0711, 0x0711 }, { 0x0730, 0x074a },
+    { 0x0900, 0x0902 }, { 0x093a, 0x093a }, { 0x093c, 0x093c }, { 0x0941, 0x0948 },
+    { 0x094d, 0x094d }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 }, { 0x0e31, 0x0e31 },
+    { 0x0e34, 0x0e3a }, { 0x0e47, 0x0e4e }, { 0x1ab0, 0x1aff }, { 0x1dc0, 0x1dff },
+    { 0x200b, 0x200f }, { 0x202a, 0x202e }, { 0x2060, 0x2064 }, { 0x20d0, 0x20ff },
+    { 0x302a, 0x302d }, { 0x3099, 0x309a }, { 0xfe00, 0xfe0f }, { 0xfe20, 0xfe2f },
+    { 0xfeff, 0xfeff }, { 0x1f3fb, 0x1f3ff }, { 0xe0001, 0xe007f }, { 0xe0100, 0xe01ef }
+};
+
+/* East Asian wide and fullwidth characters and emoji presentation. */
+static const range double_width[] = {
+    { 0x1100, 0x115f }, { 0x231a, 0x231b }, { 0x2329, 0x232a }, { 0x23e9, 0x23ec },
+    { 0x23f0, 0x23f0 }, { 0x23f3, 0x23f3 }, { 0x25fd, 0x25fe }, { 0x2614, 0x2615 },
+    { 0x2648, 0x2653 }, { 0x267f, 0x267f }, { 0x2693, 0x2693 }, { 0x26a1, 0x26a1 },
+    { 0x26aa, 0x26ab }, { 0x26bd, 0x26be }, { 0x26c4, 0x26c5 }, { 0x26ce, 0x26ce },
+    { 0x26d4, 0x26d4 }, { 0x26ea, 0x26ea }, { 0x26f2, 0x26f3 }, { 0x26f5, 0x26f5 },
+    { 0x26fa, 0x26fa }, { 0x26fd, 0x26fd }, { 0x2705, 0x2705 }, { 0x270a, 0x270b },
+    { 0x2728, 0x2728 }, { 0x274c, 0x274c }, { 0x274e, 0x274e }, { 0x2753, 0x2755 },
+    { 0x2757, 0x2757 }, { 0x2795, 0x2797 }, { 0x27b0, 0x27b0 }, { 0x27bf, 0x27bf },
+    { 0x2b1b, 0x2b1c }, { 0x2b50, 0x2b50 }, { 0x2b55, 0x2b55 }, { 0x2e80, 0x3029 },
+    { 0x302e, 0x303e }, { 0x3041, 0x3098 }, { 0x309b, 0x33ff }, { 0x3400, 0x4dbf },
+    { 0x4e00, 0x9fff }, { 0xa000, 0xa4cf }, { 0xa960, 0xa97f }, { 0xac00, 0xd7a3 },
+    { 0xf900, 0xfaff }, { 0xfe10, 0xfe19 }, { 0xfe30, 0xfe6f }, { 0xff00, 0xff60 },
+    { 0xffe0, 0xffe6 }, { 0x16fe0, 0x16fe4 }, { 0x17000, 0x18cff }, { 0x1b000, 0x1b2ff },
+    { 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf }, { 0x1f18e, 0x1f18e }, { 0x1f191, 0x1f19a },
+    { 0x1f200, 0x1f2ff }, { 0x1f300, 0x1f320 }, { 0x1f32d, 0x1f335 }, { 0x1f337, 0x1f37c },
+    { 0x1f37e, 0x1f393 }, { 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 }, { 0x1f3e0, 0x1f3f0 },
+    { 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f3fa }, { 0x1f400, 0x1f43e }, { 0x1f440, 0x1f440 },
+    { 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d }, { 0x1f54b, 0x1f54e }, { 0x1f550, 0x1f567 },
+    { 0x1f57a, 0x1f57a }, { 0x1f595, 0x1f596 }, { 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f },
+    { 0x1f680, 0x1f6c5 }, { 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 }, { 0x1f6d5, 0x1f6d7 },
+    { 0x1f6dc, 0x1f6df }, { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc }, { 0x1f7e0, 0x1f7eb },
+    { 0x1f7f0, 0x1f7f0 }, { 0x1f90c, 0x1f93a }, { 0x1f93c, 0x1f945 }, { 0x1f947, 0x1f9ff },
+    { 0x1fa70, 0x1faff }, { 0x20000, 0x2fffd }, { 0x30000, 0x3fffd }
+};
+
+static bool in_table(uint32_t c, const range *table, size_t size) {
+    size_t lo = 0, hi = size;
+
+    if (c < table[0].first || c > table[size-1].last)
+        return false;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (c > table[mid].last)
+            lo = mid + 1;
+        else if (c < table[mid].first)
+            hi = mid;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+/* Returns the display width of c, or -1 for control characters. */
+static int char_width(uint32_t c) {
+    if (c < 0x20 || (c >= 0x7f && c < 0xa0))
+        return -1;
+    if (c < 0x300)
+        return 1;
+    if (in_table(c, zero_width, sizeof(zero_width) / sizeof(range)))
+        return 0;
+    if (in_table(c, double_width, sizeof(double_width) / sizeof(range)))
+        return 2;
+    return 1;
+}
+
+/* Decodes one character, rejecting overlong forms, surrogates and
+ * anything past U+10FFFF. Returns its length or 0 if malformed. */
+static size_t decode(const unsigned char *p, size_t len, uint32_t *c) {
+    size_t n;
+
+    if (p[0] < 0x80) {
+        *c = p[0];
+        return 1;
+    } else if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+        n = 2;
+        *c = p[0] & 0x1f;
+    } else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+        n = 3;
+        *c = p[0] & 0x0f;
+    } else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+        n = 4;
+        *c = p[0] & 0x07;
+    } else
+        return 0;
+
+    if (n > len)
+        return 0;
+
+    for (size_t i = 1; i < n; ++i) {
+        if ((p[i] & 0xc0) != 0x80)
+            return 0;
+        *c = (*c << 6) | (p[i] & 0x3f);
+    }
+
+    if ((n == 3 && *c < 0x800) || (n == 4 && (*c < 0x10000 || *c > 0x10ffff)) ||
+        (*c >= 0xd800 && *c <= 0xdfff))
+        return 0;
+
+    return n;
+}
+
+/* True if all eight bytes of w are printable ASCII, i.e. none has the
+ * high bit set, is below 0x20 or is DEL. The tests are the usual SWAR
+ * "has byte less than" and "has zero byte" tricks. */
+static bool plain_ascii(uint64_t w) {
+    uint64_t del;
+
+    if (w & HIGHS)
+        return false;
+
+    del = w ^ (ONES * 0x7f);
+    return !(((w - ONES * 0x20) & ~w & HIGHS) | ((del - ONES) & ~del & HIGHS));
+}
+
+/* Measures s against max_cols in a single pass. If all of s fits, the
+ * span covers it. Otherwise it covers the longest prefix that leaves a
+ * column for the ellipsis, and the scan stops right there. Malformed
+ * bytes and control characters count one column each; they are
+ * replaced when printed. */
+void utf8_fit(const char *s, size_t len, size_t max_cols, utf8_span *span) {
+    const unsigned char *p = (const unsigned char*) s;
+    size_t i = 0, cols = 0, limit = max_cols - 1;
+    utf8_span cut = { 0, 0, true, true };
+    bool valid = true, cut_set = false;
+
+    assert(s);
+    assert(span);
+    assert(max_cols > 0);
+
+    while (i < len) {
+        uint32_t c;
+        size_t n;
+        int width;
+
+        while (len - i >= 8 && cols + 8 <= limit) {
+            uint64_t w;
+
+            memcpy(&w, p + i, 8);
+            if (!plain_ascii(w))
+                break;
+
+            i += 8;
+            cols += 8;
+        }
+
+        if (i == len)
+            break;
+
+        if ((n = decode(p + i, len - i, &c)) == 0 || (width = char_width(c)) < 0) {
+            n = n ? n : 1;
+            width = 1;
+            valid = false;
+        }
+
+        if (!cut_set && cols + width > limit) {
+            cut.bytes = i;
+            cut.cols = cols;
+            cut.valid = valid;
+            cut_set = true;
+        }
+
+        if (cols + width > max_cols) {
+            *span = cut;
+            return;
+        }
+
+        cols += width;
+        i += n;
+    }
+
+    span->bytes = len;
+    span->cols = cols;
+    span->truncated = false;
+    span->valid = valid;
+}
+
+/* Prints the span measured by utf8_fit(), replacing whatever it found
+ * malformed with '?', and pads it with spaces to width columns. */
+void utf8_print(FILE *f, const char *s, const utf8_span *span, size_t width) {
+    const unsigned char *p = (const unsigned char*) s;
+    size_t cols = span->cols;
+
+    if (span->valid)
+        fwrite(s, 1, span->bytes, f);
+    else {
+        size_t i = 0, run = 0;
+
+        while (i < span->bytes) {
+            uint32_t c;
+            size_t n = decode(p + i, span->bytes - i, &c);
+
+            if (n > 0 && char_width(c) >= 0) {
+                i += n;
+                continue;
+            }
+
+            fwrite(s + run, 1, i - run, f);
+            fputc('?', f);
+            i += n ? n : 1;
+            run = i;
+        }
+        fwrite(s + run, 1, i - run, f);
+    }
+
+    if (span->truncated) {
+        fputs(ELLIPSIS, f);
+        cols++;
+    }
+
+    for (; cols < width; ++cols)
+        fputc(' ', f);
+}
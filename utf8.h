@@ -0,0 +1,37 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef utf8h
+#define utf8h
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    size_t bytes;       /* length of the prefix to print */
+    size_t cols;        /* its width in terminal columns */
+    bool truncated;     /* the rest did not fit, an ellipsis goes after the prefix */
+    bool valid;         /* the prefix is well formed and free of control characters */
+} utf8_span;
+
+void utf8_fit(const char *s, size_t len, size_t max_cols, utf8_span *span);
+void utf8_print(FILE *f, const char *s, const utf8_span *span, size_t width);
+
+#endif
@@ -20,7 +20,9 @@
 #include "util.h"
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
 #include <string.h>
+#include <inttypes.h>
 
 void *xmalloc(size_t size) {
     void *p;
@@ -90,3 +92,78 @@ void assert_not_reached() {
     printf("Code should not be reached at %s:%u, function %s(). Aborting.", __FILE__, __LINE__, __func__);
     abort();
 }
+
+void byte_to_string(char *buf, size_t buflen, int64_t byte) {
+    if (byte < (1 << 10))
+        snprintf(buf, buflen, "%" PRId64 "B", byte);
+    else if (byte < (1 << 20))
+        snprintf(buf, buflen, "%.1fKiB", (double) byte / (1 << 10));
+    else if (byte < (1 << 30))
+        snprintf(buf, buflen, "%.1fMiB", (double) byte / (1 << 20));
+    else if (byte < (1L << 40))
+        snprintf(buf, buflen, "%.1fGiB", (double) byte / (1L << 30));
+    else if (byte < (1L << 50))
+        snprintf(buf, buflen, "%.1fTiB", (double) byte / (1LL << 40));
+    else
+        snprintf(buf, buflen, "Inf");
+}
+
+/* Our directory below the XDG base directory named by variable, such as
+ * XDG_CACHE_HOME, or below its default ~/fallback when that is unset.
+ * NULL without either. */
+char *user_dir(const char *variable, const char *fallback) {
+    const char *base;
+    char *dir;
+
+    assert(variable);
+    assert(fallback);
+
+    if ((base = getenv(variable)) && *base) {
+        dir = xmalloc(strlen(base)+sizeof("/rtorrent-cli"));
+        sprintf(dir, "%s/rtorrent-cli", base);
+    } else if ((base = getenv("HOME")) && *base) {
+        dir = xmalloc(strlen(base)+strlen(fallback)+sizeof("//rtorrent-cli"));
+        sprintf(dir, "%s/%s/rtorrent-cli", base, fallback);
+    } else
+        return NULL;
+
+    return dir;
+}
+
+/* Reads the whole file, followed by a terminating '\0' that len does not
+ * count. Returns NULL with errno set if it cannot be read. */
+char *read_file(const char *path, size_t *len) {
+    size_t allocated = 1 << 16, n;
+    char *buf;
+    FILE *f;
+
+    assert(path);
+    assert(len);
+
+    if (!(f = fopen(path, "rb")))
+        return NULL;
+
+    *len = 0;
+    buf = xmalloc(allocated);
+
+    while ((n = fread(buf + *len, 1, allocated - *len - 1, f)) > 0) {
+        *len += n;
+        if (allocated - *len == 1) {
+            allocated *= 2;
+            buf = xrealloc(buf, allocated);
+        }
+    }
+    buf[*len] = '\0';
+
+    if (ferror(f)) {
+        int saved = errno ? errno : EIO;
+
+        fclose(f);
+        xfree(buf);
+        errno = saved;
+        return NULL;
+    }
+
+    fclose(f);
+    return buf;
+}
@@ -21,6 +21,7 @@
 #define utilh
 
 #include <stdlib.h>
+#include <stdint.h>
 
 void *xmalloc(size_t size);
 void *xmalloc0(size_t size);
@@ -32,5 +33,10 @@ void xfree(void *p);
 void error(const char *msg);
 void assert_not_reached();
 
+void byte_to_string(char *buf, size_t buflen, int64_t byte);
+
+char *user_dir(const char *variable, const char *fallback);
+char *read_file(const char *path, size_t *len);
+
 
 #endif
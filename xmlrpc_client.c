@@ -25,6 +25,7 @@
 #include "util.h"
 #include "xmlrpc_client.h"
 #include "scgi_proxy.h"
+#include "cache_daemon.h"
 
 static void prepare_xml(xmlrpc_env *env, xmlrpc_mem_block **memblock, const char *method, xmlrpc_value *param) {
     XMLRPC_ASSERT_ENV_OK(env);
@@ -39,7 +40,7 @@ static void prepare_xml(xmlrpc_env *env, xmlrpc_mem_block **memblock, const char
     xmlrpc_serialize_call(env, *memblock, method, param);
 }
 
-static void parse_xml(xmlrpc_env *env, char *xml, int xml_size, xmlrpc_value **result, int *fault_code, const char **fault_string) {
+static void parse_xml(xmlrpc_env *env, const char *xml, size_t xml_size, xmlrpc_value **result, int *fault_code, const char **fault_string) {
     xmlrpc_env respEnv;
 
     XMLRPC_ASSERT_ENV_OK(env);
@@ -58,11 +59,21 @@ static void parse_xml(xmlrpc_env *env, char *xml, int xml_size, xmlrpc_value **r
     xmlrpc_env_clean(&respEnv);
 }
 
-xmlrpc_value *xmlrpc_call_scgi_server_params(xmlrpc_env *env, const char *server, const char *port, const char *method, xmlrpc_value *param) {
-    int sockfd = -1, fault_code;
+static int connect_server(xmlrpc_env *env, int *sockfd, const char *server, const char *port) {
+    /* a local cache daemon, if one runs for this server, answers instead */
+    if (cache_daemon_connect(sockfd, server, port) != 0 &&
+        scgi_create_transport(sockfd, server, port) != 0) {
+        *sockfd = -1;
+        xmlrpc_env_set_fault_formatted(env, -32300, "Could not connect");
+        return -1;
+    }
+
+    return 0;
+}
+
+char *xmlrpc_call_scgi_server_raw(xmlrpc_env *env, const char *server, const char *port, const char *method, xmlrpc_value *param, size_t *len) {
+    int sockfd = -1;
     char *buff = NULL;
-    xmlrpc_value *result = NULL;
-    const char *fault_string = NULL;
     xmlrpc_mem_block *memblock = NULL;
 
     XMLRPC_ASSERT_ENV_OK(env);
@@ -71,6 +82,7 @@ xmlrpc_value *xmlrpc_call_scgi_server_params(xmlrpc_env *env, const char *server
     assert(port);
     assert(method);
     assert(param);
+    assert(len);
 
     prepare_xml(env, &memblock, method, param);
     if (env->fault_occurred)
@@ -78,26 +90,91 @@ xmlrpc_value *xmlrpc_call_scgi_server_params(xmlrpc_env *env, const char *server
 
     xmlrpc_DECREF(param);
 
-    if (scgi_create_transport(&sockfd, server, port) < 0) {
-        xmlrpc_env_set_fault_formatted(env, -32300, "Could not connect");
+    if (connect_server(env, &sockfd, server, port) < 0)
         goto finish;
-    }
 
-    scgi_make_call(&sockfd, XMLRPC_MEMBLOCK_CONTENTS(char, memblock), XMLRPC_MEMBLOCK_SIZE(char, memblock), &buff);
+    if (scgi_make_call(&sockfd, XMLRPC_MEMBLOCK_CONTENTS(char, memblock), XMLRPC_MEMBLOCK_SIZE(char, memblock), &buff) <= 0) {
+        xmlrpc_env_set_fault_formatted(env, -32300, "No response from server");
+        goto finish;
+    }
 
     /*
     printf("%s\n", buff);
     */
 
-    parse_xml(env, buff, strlen(buff), &result, &fault_code, &fault_string);
+    *len = strlen(buff);
 
 finish:
     if (sockfd != -1)
         close(sockfd);
 
-    xfree(buff);
-    xfree((char*) fault_string);
     XMLRPC_MEMBLOCK_FREE(char, memblock);
 
+    return buff;
+}
+
+xmlrpc_value *xmlrpc_parse_scgi_response(xmlrpc_env *env, const char *xml, size_t len) {
+    int fault_code;
+    xmlrpc_value *result = NULL;
+    const char *fault_string = NULL;
+
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(xml);
+
+    parse_xml(env, xml, len, &result, &fault_code, &fault_string);
+
+    if (!env->fault_occurred && !result)
+        xmlrpc_env_set_fault(env, fault_code, fault_string);
+
+    xfree((char*) fault_string);
+
     return result;
 }
+
+xmlrpc_value *xmlrpc_call_scgi_server_params(xmlrpc_env *env, const char *server, const char *port, const char *method, xmlrpc_value *param) {
+    size_t len;
+    char *buff;
+    xmlrpc_value *result = NULL;
+
+    buff = xmlrpc_call_scgi_server_raw(env, server, port, method, param, &len);
+    if (env->fault_occurred)
+        goto finish;
+
+    result = xmlrpc_parse_scgi_response(env, buff, len);
+
+finish:
+    xfree(buff);
+
+    return result;
+}
+
+/* The getters report values of an unexpected type as faults instead of
+ * trusting the server, the caller checks env as for any other call. */
+void xmlrpc_get_string(xmlrpc_env *env, xmlrpc_value *value, const char **string) {
+    if (xmlrpc_value_type(value) != XMLRPC_TYPE_STRING) {
+        xmlrpc_env_set_fault(env, -32300, "Expected a string in the reply");
+        return;
+    }
+    xmlrpc_read_string(env, value, string);
+}
+
+/* rtorrent answers with i8 or int depending on its version. */
+void xmlrpc_get_int64(xmlrpc_env *env, xmlrpc_value *value, int64_t *num) {
+    xmlrpc_int64 tmp = 0;
+    int small = 0;
+
+    switch (xmlrpc_value_type(value)) {
+        case XMLRPC_TYPE_I8:
+            xmlrpc_read_i8(env, value, &tmp);
+            break;
+        case XMLRPC_TYPE_INT:
+            xmlrpc_read_int(env, value, &small);
+            tmp = small;
+            break;
+        default:
+            xmlrpc_env_set_fault(env, -32300, "Expected an integer in the reply");
+            return;
+    }
+
+    *num = (int64_t) tmp;
+}
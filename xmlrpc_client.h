@@ -20,7 +20,14 @@
 #ifndef xmlclient
 #define xmlclient
 
+#include <stdint.h>
 #include <xmlrpc-c/base.h>
+
+char *xmlrpc_call_scgi_server_raw(xmlrpc_env *env, const char *server, const char *port, const char *method, xmlrpc_value *param, size_t *len);
+xmlrpc_value *xmlrpc_parse_scgi_response(xmlrpc_env *env, const char *xml, size_t len);
 xmlrpc_value *xmlrpc_call_scgi_server_params(xmlrpc_env *env, const char *server, const char *port, const char *method, xmlrpc_value *param);
 
+void xmlrpc_get_string(xmlrpc_env *env, xmlrpc_value *value, const char **string);
+void xmlrpc_get_int64(xmlrpc_env *env, xmlrpc_value *value, int64_t *num);
+
 #endif
@@ -0,0 +1,368 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "util.h"
+#include "xmlrpc_stream.h"
+
+typedef struct {
+    xmlrpc_type type;
+    size_t offset;
+    size_t length;
+} pending_field;
+
+struct xmlrpc_stream {
+    xmlrpc_stream_row_fn fn;
+    void *data;
+
+    /* input that has not been tokenized yet */
+    char *buf;
+    size_t len;
+    size_t allocated;
+
+    /* decoded text of the fields of the current row */
+    char *arena;
+    size_t arena_len;
+    size_t arena_allocated;
+
+    pending_field *fields;
+    size_t nfields;
+    size_t fields_allocated;
+    xmlrpc_stream_field *out;
+    size_t out_allocated;
+
+    int array_depth;
+    bool in_value;
+    bool collecting;
+    xmlrpc_type type;
+    size_t text_start;
+
+    bool fault;
+    int fault_code;
+    char *fault_string;
+};
+
+static void arena_append(xmlrpc_stream *stream, const char *s, size_t len) {
+    if (stream->arena_len + len + 1 > stream->arena_allocated) {
+        while (stream->arena_len + len + 1 > stream->arena_allocated)
+            stream->arena_allocated = stream->arena_allocated ? stream->arena_allocated * 2 : 256;
+        stream->arena = xrealloc(stream->arena, stream->arena_allocated);
+    }
+
+    memcpy(stream->arena + stream->arena_len, s, len);
+    stream->arena_len += len;
+}
+
+static void arena_append_codepoint(xmlrpc_stream *stream, unsigned long c) {
+    char utf8[4];
+    size_t n;
+
+    if (c < 0x80) {
+        utf8[0] = (char) c;
+        n = 1;
+    } else if (c < 0x800) {
+        utf8[0] = (char) (0xc0 | (c >> 6));
+        utf8[1] = (char) (0x80 | (c & 0x3f));
+        n = 2;
+    } else if (c < 0x10000) {
+        utf8[0] = (char) (0xe0 | (c >> 12));
+        utf8[1] = (char) (0x80 | ((c >> 6) & 0x3f));
+        utf8[2] = (char) (0x80 | (c & 0x3f));
+        n = 3;
+    } else {
+        utf8[0] = (char) (0xf0 | ((c >> 18) & 0x07));
+        utf8[1] = (char) (0x80 | ((c >> 12) & 0x3f));
+        utf8[2] = (char) (0x80 | ((c >> 6) & 0x3f));
+        utf8[3] = (char) (0x80 | (c & 0x3f));
+        n = 4;
+    }
+
+    arena_append(stream, utf8, n);
+}
+
+/* Appends character data with the predefined and numeric entities
+ * resolved. Unknown entities are kept verbatim. */
+static void append_text(xmlrpc_stream *stream, const char *p, const char *end) {
+    static const struct {
+        const char *name;
+        char c;
+    } entities[] = {
+        { "lt;", '<' }, { "gt;", '>' }, { "amp;", '&' },
+        { "quot;", '"' }, { "apos;", '\'' }, { NULL, 0 }
+    };
+
+    while (p < end) {
+        const char *amp = memchr(p, '&', end - p);
+        bool known = false;
+
+        if (!amp) {
+            arena_append(stream, p, end - p);
+            return;
+        }
+
+        arena_append(stream, p, amp - p);
+        p = amp + 1;
+
+        if (p < end && *p == '#') {
+            char *num_end;
+            unsigned long c;
+
+            if (p + 1 < end && (p[1] == 'x' || p[1] == 'X'))
+                c = strtoul(p + 2, &num_end, 16);
+            else
+                c = strtoul(p + 1, &num_end, 10);
+
+            if (num_end < end && *num_end == ';' && c > 0 && c <= 0x10ffff) {
+                arena_append_codepoint(stream, c);
+                p = num_end + 1;
+                known = true;
+            }
+        } else {
+            for (int i = 0; entities[i].name; ++i) {
+                size_t n = strlen(entities[i].name);
+
+                if ((size_t) (end - p) >= n && strncmp(p, entities[i].name, n) == 0) {
+                    arena_append(stream, &entities[i].c, 1);
+                    p += n;
+                    known = true;
+                    break;
+                }
+            }
+        }
+
+        if (!known)
+            arena_append(stream, "&", 1);
+    }
+}
+
+static int64_t field_int(const char *s, size_t len) {
+    char tmp[32];
+
+    if (len >= sizeof(tmp))
+        len = sizeof(tmp) - 1;
+    memcpy(tmp, s, len);
+    tmp[len] = '\0';
+
+    return strtoll(tmp, NULL, 10);
+}
+
+static void emit_row(xmlrpc_stream *stream) {
+    if (stream->nfields > stream->out_allocated) {
+        stream->out_allocated = stream->nfields;
+        stream->out = xrealloc(stream->out, sizeof(xmlrpc_stream_field) * stream->out_allocated);
+    }
+
+    for (size_t i = 0; i < stream->nfields; ++i) {
+        const pending_field *f = &stream->fields[i];
+        xmlrpc_stream_field *out = &stream->out[i];
+
+        out->type = f->type;
+        out->string = stream->arena + f->offset;
+        out->length = f->length;
+        out->i = f->type == XMLRPC_TYPE_STRING ? 0 : field_int(out->string, out->length);
+    }
+
+    stream->fn(stream->out, stream->nfields, stream->data);
+
+    stream->nfields = 0;
+    stream->arena_len = 0;
+}
+
+static void end_value(xmlrpc_stream *stream) {
+    size_t length = stream->arena_len - stream->text_start;
+
+    stream->in_value = stream->collecting = false;
+
+    if (stream->array_depth == 2) {
+        if (stream->nfields == stream->fields_allocated) {
+            stream->fields_allocated = stream->fields_allocated ? stream->fields_allocated * 2 : 16;
+            stream->fields = xrealloc(stream->fields, sizeof(pending_field) * stream->fields_allocated);
+        }
+
+        stream->fields[stream->nfields].type = stream->type;
+        stream->fields[stream->nfields].offset = stream->text_start;
+        stream->fields[stream->nfields].length = length;
+        stream->nfields++;
+
+        arena_append(stream, "", 0);
+        stream->arena[stream->arena_len++] = '\0';
+        return;
+    }
+
+    /* outside of the rows only the members of a fault are of interest */
+    if (stream->fault) {
+        if (stream->type == XMLRPC_TYPE_STRING && !stream->fault_string) {
+            stream->fault_string = xmalloc(length + 1);
+            memcpy(stream->fault_string, stream->arena + stream->text_start, length);
+            stream->fault_string[length] = '\0';
+        } else if (stream->type == XMLRPC_TYPE_INT)
+            stream->fault_code = (int) field_int(stream->arena + stream->text_start, length);
+    }
+    stream->arena_len = stream->text_start;
+}
+
+static bool name_is(const char *name, size_t len, const char *expected) {
+    return strlen(expected) == len && strncmp(name, expected, len) == 0;
+}
+
+static void handle_tag(xmlrpc_stream *stream, const char *tag, const char *close) {
+    bool closing = false, empty = close[-1] == '/';
+    const char *name = tag;
+    size_t len;
+
+    if (*name == '/') {
+        closing = true;
+        name++;
+    }
+    len = strcspn(name, " \t\r\n/>");
+
+    if (name_is(name, len, "value")) {
+        if (closing) {
+            if (stream->in_value)
+                end_value(stream);
+        } else {
+            stream->in_value = stream->collecting = true;
+            stream->type = XMLRPC_TYPE_STRING;
+            stream->text_start = stream->arena_len;
+            if (empty)
+                end_value(stream);
+        }
+    } else if (name_is(name, len, "array") || name_is(name, len, "struct")) {
+        if (!closing && stream->in_value) {
+            stream->arena_len = stream->text_start;
+            stream->in_value = stream->collecting = false;
+        }
+
+        if (name[0] == 'a' && !empty) {
+            if (closing) {
+                if (stream->array_depth == 2)
+                    emit_row(stream);
+                stream->array_depth--;
+            } else if (++stream->array_depth == 2) {
+                stream->nfields = 0;
+                stream->arena_len = 0;
+            }
+        }
+    } else if (name_is(name, len, "fault")) {
+        stream->fault = true;
+    } else if (stream->in_value) {
+        if (closing) {
+            stream->collecting = false;
+            return;
+        }
+
+        stream->arena_len = stream->text_start;
+        stream->collecting = !empty;
+
+        if (name_is(name, len, "i8"))
+            stream->type = XMLRPC_TYPE_I8;
+        else if (name_is(name, len, "i4") || name_is(name, len, "int"))
+            stream->type = XMLRPC_TYPE_INT;
+        else if (name_is(name, len, "boolean"))
+            stream->type = XMLRPC_TYPE_BOOL;
+        else if (name_is(name, len, "double"))
+            stream->type = XMLRPC_TYPE_DOUBLE;
+        else
+            stream->type = XMLRPC_TYPE_STRING;
+    }
+}
+
+xmlrpc_stream *xmlrpc_stream_new(xmlrpc_stream_row_fn fn, void *data) {
+    xmlrpc_stream *stream;
+
+    assert(fn);
+
+    stream = xmalloc0(sizeof(xmlrpc_stream));
+    stream->fn = fn;
+    stream->data = data;
+    return stream;
+}
+
+void xmlrpc_stream_feed(xmlrpc_stream *stream, const char *buf, size_t len) {
+    const char *p, *end;
+
+    assert(stream);
+
+    if (stream->len + len > stream->allocated) {
+        while (stream->len + len > stream->allocated)
+            stream->allocated = stream->allocated ? stream->allocated * 2 : 1 << 14;
+        stream->buf = xrealloc(stream->buf, stream->allocated);
+    }
+    memcpy(stream->buf + stream->len, buf, len);
+    stream->len += len;
+
+    p = stream->buf;
+    end = stream->buf + stream->len;
+
+    while (p < end) {
+        if (*p == '<') {
+            const char *close = memchr(p, '>', end - p);
+
+            if (!close)
+                break;
+
+            handle_tag(stream, p + 1, close);
+            p = close + 1;
+        } else {
+            const char *lt = memchr(p, '<', end - p);
+
+            /* text is only decoded once its end is known, so that no
+             * entity is ever cut in half */
+            if (!lt) {
+                if (!stream->collecting)
+                    p = end;
+                break;
+            }
+
+            if (stream->collecting)
+                append_text(stream, p, lt);
+            p = lt;
+        }
+    }
+
+    stream->len = end - p;
+    memmove(stream->buf, p, stream->len);
+}
+
+void xmlrpc_stream_finish(xmlrpc_env *env, xmlrpc_stream *stream) {
+    XMLRPC_ASSERT_ENV_OK(env);
+    assert(stream);
+
+    if (stream->fault)
+        xmlrpc_env_set_fault(env, stream->fault_code,
+                             stream->fault_string ? stream->fault_string : "Unknown fault");
+    else if (stream->array_depth != 0 || stream->len != 0)
+        xmlrpc_env_set_fault_formatted(env, -32300, "Truncated response from server");
+}
+
+void xmlrpc_stream_free(xmlrpc_stream *stream) {
+    if (!stream)
+        return;
+
+    xfree(stream->fault_string);
+    xfree(stream->out);
+    xfree(stream->fields);
+    xfree(stream->arena);
+    xfree(stream->buf);
+    xfree(stream);
+}
@@ -0,0 +1,48 @@
+/***
+ * This file is part of rtorrent-cli
+ * Copyright (C) 2013 Damir Jelić
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ ***/
+
+#ifndef xmlrpcstreamh
+#define xmlrpcstreamh
+
+#include <stddef.h>
+#include <stdint.h>
+#include <xmlrpc-c/base.h>
+
+/* Incremental decoder for multicall responses: an array of rows, each an
+ * array of scalars. Rows are handed out as soon as they are complete and
+ * forgotten afterwards, so memory stays bounded by the largest row no
+ * matter how large the response is. */
+
+typedef struct {
+    xmlrpc_type type;
+    const char *string;
+    size_t length;
+    int64_t i;
+} xmlrpc_stream_field;
+
+typedef void (*xmlrpc_stream_row_fn)(const xmlrpc_stream_field *fields, size_t count, void *data);
+
+typedef struct xmlrpc_stream xmlrpc_stream;
+
+xmlrpc_stream *xmlrpc_stream_new(xmlrpc_stream_row_fn fn, void *data);
+void xmlrpc_stream_feed(xmlrpc_stream *stream, const char *buf, size_t len);
+void xmlrpc_stream_finish(xmlrpc_env *env, xmlrpc_stream *stream);
+void xmlrpc_stream_free(xmlrpc_stream *stream);
+
+#endif